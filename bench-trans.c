@@ -0,0 +1,159 @@
+/*
+ * bench-trans.c - Times the registered transpose functions on the real
+ *     machine, as opposed to test-trans which counts their misses in
+ *     the simulator. Each function is run on heap matrices of any size,
+ *     checked with is_transpose(), and compared with correctTrans()
+ *     and with the bandwidth of a plain memcpy of the same bytes.
+ */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cachelab.h"
+#include "walltime.h"
+
+/* Runs of each function; the fastest one is reported */
+#define DEFAULT_REPEATS 5
+
+/* Alignment of the matrices, one cache line */
+#define MATRIX_ALIGNMENT 64
+
+/* External functions defined in trans.c and trans_extra.c */
+extern void registerFunctions();
+extern void registerExtraFunctions();
+extern int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+extern void transpose_parallel_first_touch(int M, int N, int A[N][M], int B[M][N]);
+
+/* External variables defined in cachelab.c */
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+/*
+ * time_transpose - Run one transpose function repeats times and return
+ *     the fastest run in seconds. B is cleared first so a function that
+ *     writes nothing cannot pass on an earlier function's result. An
+ *     in-place function gets a fresh copy of A in B before every run,
+ *     outside the timed part.
+ */
+static double time_transpose(void (*trans)(int M, int N, int[N][M], int[M][N]), int in_place,
+                             int M, int N, int* A, int* B, int repeats, int* correct)
+{
+    double best = -1;
+    int r;
+
+    memset(B, 0, (size_t) M * N * sizeof(int));
+    for (r = 0; r < repeats; r++) {
+        if (in_place)
+            memcpy(B, A, (size_t) M * N * sizeof(int));
+        double start = now();
+        (*trans)(M, N, (int (*)[M]) (in_place ? B : A), (int (*)[N]) B);
+        double elapsed = now() - start;
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+    *correct = is_transpose(M, N, (int (*)[M]) A, (int (*)[N]) B);
+    return best;
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] -M <cols> -N <rows> [-r <num>] [-F <num>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -M <cols>   Number of matrix columns\n");
+    printf("  -N <rows>   Number of matrix rows\n");
+    printf("  -r <num>    Runs per function, the fastest counts (default %d)\n", DEFAULT_REPEATS);
+    printf("  -F <num>    Only time registered function <num>\n");
+    printf("Example: %s -M 4096 -N 4096\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int M = 0, N = 0;
+    int repeats = DEFAULT_REPEATS;
+    int selected = -1;
+    int i, c, correct;
+    int* A;
+    int* B;
+
+    while ((c = getopt(argc, argv, "M:N:r:F:h")) != -1) {
+        switch (c) {
+        case 'M':
+            M = atoi(optarg);
+            break;
+        case 'N':
+            N = atoi(optarg);
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            break;
+        case 'F':
+            selected = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (M <= 0 || N <= 0 || repeats <= 0) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    registerFunctions();
+    registerExtraFunctions();
+    if (selected >= func_counter) {
+        printf("Error: There are only %d registered functions\n", func_counter);
+        exit(1);
+    }
+
+    if (posix_memalign((void**) &A, MATRIX_ALIGNMENT, (size_t) M * N * sizeof(int)) != 0 ||
+        posix_memalign((void**) &B, MATRIX_ALIGNMENT, (size_t) M * N * sizeof(int)) != 0) {
+        printf("Error: Unable to allocate two %d x %d matrices\n", N, M);
+        exit(1);
+    }
+    /* Place the pages where the multithreaded transpose's threads use
+       them before anything else writes the matrices */
+    transpose_parallel_first_touch(M, N, (int (*)[M]) A, (int (*)[N]) B);
+    initMatrix(M, N, (int (*)[M]) A, (int (*)[N]) B);
+
+    /* Every byte of A is read once and every byte of B written once */
+    double bytes = 2.0 * M * N * sizeof(int);
+
+    /* A copy moves the same bytes with no reordering at all */
+    double copy = -1;
+    for (i = 0; i < repeats; i++) {
+        double start = now();
+        memcpy(B, A, (size_t) M * N * sizeof(int));
+        double elapsed = now() - start;
+        if (copy < 0 || elapsed < copy)
+            copy = elapsed;
+    }
+
+    double baseline = time_transpose(correctTrans, 0, M, N, A, B, repeats, &correct);
+    printf("%dx%d, best of %d runs\n", N, M, repeats);
+    printf("memcpy (one core):       %10.3f ms %8.2f GB/s\n", copy * 1e3, bytes / copy * 1e-9);
+    printf("baseline (correctTrans): %10.3f ms %8.2f GB/s\n", baseline * 1e3, bytes / baseline * 1e-9);
+
+    for (i = 0; i < func_counter; i++) {
+        if (selected >= 0 && i != selected)
+            continue;
+        double elapsed = time_transpose(func_list[i].func_ptr, func_list[i].in_place, M, N, A, B, repeats, &correct);
+        printf("func %d (%s): %10.3f ms %8.2f GB/s (%.0f%% of memcpy) speedup:%.2f correct:%d\n",
+               i, func_list[i].description, elapsed * 1e3, bytes / elapsed * 1e-9, 100 * copy / elapsed,
+               baseline / elapsed, correct);
+    }
+
+    free(A);
+    free(B);
+    return 0;
+}
@@ -14,12 +14,12 @@ int func_counter = 0;
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded. 
  */
-void printSummary(int hits, int misses, int evictions)
+void printSummary(long long hits, long long misses, long long evictions)
 {
-    printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
+    printf("hits:%lld misses:%lld evictions:%lld\n", hits, misses, evictions);
     FILE* output_fp = fopen(".csim_results", "w");
     assert(output_fp);
-    fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
+    fprintf(output_fp, "%lld %lld %lld\n", hits, misses, evictions);
     fclose(output_fp);
 }
 
@@ -75,9 +75,21 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
 {
     func_list[func_counter].func_ptr = trans;
     func_list[func_counter].description = desc;
+    func_list[func_counter].in_place = 0;
     func_list[func_counter].correct = 0;
     func_list[func_counter].num_hits = 0;
     func_list[func_counter].num_misses = 0;
     func_list[func_counter].num_evictions =0;
     func_counter++;
 }
+
+/* 
+ * registerInPlaceTransFunction - Add the given in-place trans function
+ *     into your list of functions to be tested
+ */
+void registerInPlaceTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]), 
+                                  char* desc)
+{
+    registerTransFunction(trans, desc);
+    func_list[func_counter - 1].in_place = 1;
+}
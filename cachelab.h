@@ -10,19 +10,20 @@
 typedef struct trans_func{
   void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
   char* description;
+  char in_place;  /* called with A and B the same memory, holding A */
   char correct;
-  unsigned int num_hits;
-  unsigned int num_misses;
-  unsigned int num_evictions;
+  unsigned long long num_hits;
+  unsigned long long num_misses;
+  unsigned long long num_evictions;
 } trans_func_t;
 
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
  */ 
-void printSummary(int hits,  /* number of  hits */
-				  int misses, /* number of misses */
-				  int evictions); /* number of evictions */
+void printSummary(long long hits,  /* number of  hits */
+				  long long misses, /* number of misses */
+				  long long evictions); /* number of evictions */
 
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
@@ -34,4 +35,9 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/* Add a function that transposes in place: the drivers copy A into B
+   and pass B as both arguments */
+void registerInPlaceTransFunction(
+    void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
+
 #endif /* CACHELAB_TOOLS_H */
@@ -0,0 +1,334 @@
+/*
+ * csim-bench.c - Measures how fast csim itself is (make bench). It
+ *     has synthtrace write traces of a chosen size and locality, runs csim
+ *     on each of them under a set of geometries and policies, and
+ *     reports accesses per second, ns per access, peak RSS and how the
+ *     time splits between parsing and simulating (from a second run
+ *     with --parse-only). Results can be saved as a baseline; later
+ *     runs are compared with it and regressions beyond a threshold are
+ *     flagged, with a non-zero exit status.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "walltime.h"
+
+/* Defaults for the command line */
+#define DEFAULT_RECORDS 1000000
+#define DEFAULT_REPEATS 3
+#define DEFAULT_THRESHOLD 10.0
+#define DEFAULT_BASELINE "bench.baseline"
+#define TRACE_DIR ".bench"
+
+/* Longest csim command line */
+#define MAX_ARGS 32
+
+/* A synthetic trace: the synthtrace models its addresses come from */
+struct workload {
+    char* name;
+    char* description;
+    char* args;
+};
+
+static struct workload workloads[] = {
+    {"stream", "sequential 8 byte accesses over 64MB", "-m stride:1 -S 8 -F 64M"},
+    {"random", "uniform 8 byte accesses over 16MB",    "-m uniform:1 -F 16M"},
+    {"hot",    "90% Zipfian over 64MB, 10% uniform",   "-m zipf:9,uniform:1 -F 64M"},
+};
+#define NUM_WORKLOADS (int) (sizeof(workloads) / sizeof(workloads[0]))
+
+/* A csim configuration: its geometry and the models turned on */
+struct configuration {
+    char* name;
+    char* args;
+};
+
+static struct configuration configurations[] = {
+    {"direct-1KB",  "-s 5 -E 1 -b 5"},
+    {"4way-16KB",   "-s 6 -E 4 -b 6"},
+    {"8way-32KB",   "-s 6 -E 8 -b 6"},
+    {"16way-1MB",   "-s 10 -E 16 -b 6"},
+    {"8way-xor",    "-s 6 -E 8 -b 6 --index xor"},
+    {"8way-S48",    "-S 48 -E 8 -b 6"},
+    {"8way-stream", "-s 6 -E 8 -b 6 --prefetch stream"},
+    {"8way-victim", "-s 6 -E 8 -b 6 --victim 8 --mshr 8"},
+    {"8way-l2-tlb", "-s 6 -E 8 -b 6 --l2 10,16,6 --tlb 64:4 --timing"},
+};
+#define NUM_CONFIGURATIONS (int) (sizeof(configurations) / sizeof(configurations[0]))
+
+/* What one run of csim cost */
+struct measurement {
+    double seconds;
+    long peak_rss_kb;
+};
+
+/*
+ * split_args - Append the words of args to argv, which holds argc
+ *     words already; returns the new argc
+ */
+static int split_args(char* buffer, size_t size, const char* args, char* argv[], int argc)
+{
+    snprintf(buffer, size, "%s", args);
+    for (char* word = strtok(buffer, " "); word != NULL && argc < MAX_ARGS - 8; word = strtok(NULL, " "))
+        argv[argc++] = word;
+    return argc;
+}
+
+/*
+ * write_trace - Have synthtrace write records records of one workload,
+ *     70% loads, 25% stores and 5% modifies, unless the file already
+ *     has them
+ */
+static void write_trace(const char* path, int workload, long records)
+{
+    char name[256], count[32], buffer[512];
+    char* argv[MAX_ARGS];
+    int argc = 0;
+
+    /* The file name carries the record count, so an existing one can be reused */
+    if (access(path, R_OK) == 0)
+        return;
+    if (snprintf(name, sizeof(name), "%s.tmp", path) >= (int) sizeof(name)) {
+        printf("Error: Trace name %s is too long\n", path);
+        exit(1);
+    }
+    snprintf(count, sizeof(count), "%ld", records);
+    argv[argc++] = "./synthtrace";
+    argv[argc++] = "-n";
+    argv[argc++] = count;
+    argv[argc++] = "-o";
+    argv[argc++] = name;
+    argc = split_args(buffer, sizeof(buffer), workloads[workload].args, argv, argc);
+    argv[argc] = NULL;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        /* synthtrace reports its own speed on stderr */
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Error: ./synthtrace could not write %s, is it built?\n", name);
+        exit(1);
+    }
+    rename(name, path);
+}
+
+/*
+ * run_csim - Run csim once with its output thrown away, and measure
+ *     its wall time and peak resident set
+ */
+static struct measurement run_csim(const char* args, const char* trace, int parse_only)
+{
+    struct measurement m = {-1, 0};
+    char buffer[512];
+    char* argv[MAX_ARGS];
+    int argc = 0;
+
+    argv[argc++] = "./csim";
+    argc = split_args(buffer, sizeof(buffer), args, argv, argc);
+    argv[argc++] = "-t";
+    argv[argc++] = (char*) trace;
+    if (parse_only)
+        argv[argc++] = "--parse-only";
+    argv[argc] = NULL;
+
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0)
+        return m;
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        /* csim writes .csim_results, keep it out of the way of a test-csim run */
+        if (chdir(TRACE_DIR) == 0)
+            argv[0] = "../csim";
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return m;
+    m.seconds = now() - start;
+    m.peak_rss_kb = usage.ru_maxrss;
+    return m;
+}
+
+/*
+ * best_of - The fastest of repeats runs
+ */
+static struct measurement best_of(const char* args, const char* trace, int parse_only, int repeats)
+{
+    struct measurement best = {-1, 0};
+    for (int r = 0; r < repeats; r++) {
+        struct measurement m = run_csim(args, trace, parse_only);
+        if (m.seconds < 0)
+            return m;
+        if (best.seconds < 0 || m.seconds < best.seconds)
+            best.seconds = m.seconds;
+        if (m.peak_rss_kb > best.peak_rss_kb)
+            best.peak_rss_kb = m.peak_rss_kb;
+    }
+    return best;
+}
+
+/*
+ * baseline_lookup - ns per access recorded for a configuration and
+ *     workload in the baseline file, or -1
+ */
+static double baseline_lookup(const char* path, const char* key)
+{
+    char line[256], name[200];
+    double ns;
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%199s %lf", name, &ns) == 2 && strcmp(name, key) == 0) {
+            fclose(fp);
+            return ns;
+        }
+    }
+    fclose(fp);
+    return -1;
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] [-n <records>] [-r <num>] [-f <file>] [-t <percent>] [-s] [-c <name>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h            Print this help message.\n");
+    printf("  -n <records>  Records per synthetic trace (default %d)\n", DEFAULT_RECORDS);
+    printf("  -r <num>      Runs per measurement, the fastest counts (default %d)\n", DEFAULT_REPEATS);
+    printf("  -f <file>     Baseline file (default %s)\n", DEFAULT_BASELINE);
+    printf("  -t <percent>  Slowdown against the baseline that counts as a regression (default %.0f)\n",
+           DEFAULT_THRESHOLD);
+    printf("  -s            Save the results as the new baseline\n");
+    printf("  -c <name>     Only run configurations whose name contains <name>\n");
+    printf("Example: %s -n 2000000 -s\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    long records = DEFAULT_RECORDS;
+    int repeats = DEFAULT_REPEATS;
+    double threshold = DEFAULT_THRESHOLD;
+    char* baseline = DEFAULT_BASELINE;
+    char* only = NULL;
+    int save = 0;
+    int regressions = 0;
+    int c, w, k;
+    char traces[NUM_WORKLOADS][256];
+    FILE* out = NULL;
+
+    while ((c = getopt(argc, argv, "n:r:f:t:sc:h")) != -1) {
+        switch (c) {
+        case 'n':
+            records = atol(optarg);
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            break;
+        case 'f':
+            baseline = optarg;
+            break;
+        case 't':
+            threshold = atof(optarg);
+            break;
+        case 's':
+            save = 1;
+            break;
+        case 'c':
+            only = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (records <= 0 || repeats <= 0 || threshold < 0) {
+        usage(argv);
+        exit(1);
+    }
+
+    mkdir(TRACE_DIR, 0755);
+    for (w = 0; w < NUM_WORKLOADS; w++) {
+        snprintf(traces[w], sizeof(traces[w]), "%s/%s-%ld.trace", TRACE_DIR, workloads[w].name, records);
+        write_trace(traces[w], w, records);
+        printf("trace %-7s %s, %ld records\n", workloads[w].name, workloads[w].description, records);
+    }
+
+    if (save) {
+        out = fopen(baseline, "w");
+        if (out == NULL) {
+            printf("Error: Unable to write %s\n", baseline);
+            exit(1);
+        }
+    }
+
+    printf("\n%-12s %-7s %10s %10s %9s %7s %7s %9s %9s\n",
+           "config", "trace", "ms", "Macc/s", "ns/acc", "parse", "sim", "RSS(MB)", "vs base");
+    for (k = 0; k < NUM_CONFIGURATIONS; k++) {
+        if (only != NULL && strstr(configurations[k].name, only) == NULL)
+            continue;
+        for (w = 0; w < NUM_WORKLOADS; w++) {
+            /* csim runs from TRACE_DIR, so it is handed the trace by its name there */
+            const char* trace = strchr(traces[w], '/') + 1;
+            struct measurement full = best_of(configurations[k].args, trace, 0, repeats);
+            struct measurement parse = best_of(configurations[k].args, trace, 1, repeats);
+            if (full.seconds < 0 || parse.seconds < 0) {
+                printf("%-12s %-7s csim failed: ./csim %s\n", configurations[k].name, workloads[w].name,
+                       configurations[k].args);
+                regressions++;
+                continue;
+            }
+            double ns = full.seconds * 1e9 / records;
+            double parse_share = parse.seconds < full.seconds ? parse.seconds / full.seconds : 1.0;
+
+            char key[200];
+            char verdict[32] = "-";
+            snprintf(key, sizeof(key), "%s/%s/%ld", configurations[k].name, workloads[w].name, records);
+            double before = baseline_lookup(baseline, key);
+            if (before > 0) {
+                double change = (ns - before) / before * 100;
+                snprintf(verdict, sizeof(verdict), "%+.1f%%%s", change, change > threshold ? " SLOWER" : "");
+                if (change > threshold)
+                    regressions++;
+            }
+            printf("%-12s %-7s %10.1f %10.2f %9.1f %6.0f%% %6.0f%% %9.1f %9s\n",
+                   configurations[k].name, workloads[w].name, full.seconds * 1e3, records / full.seconds * 1e-6,
+                   ns, parse_share * 100, (1 - parse_share) * 100, full.peak_rss_kb / 1024.0, verdict);
+            fflush(stdout);
+            if (out != NULL)
+                fprintf(out, "%s %.3f\n", key, ns);
+        }
+    }
+
+    if (out != NULL) {
+        fclose(out);
+        printf("\nSaved baseline to %s\n", baseline);
+    }
+    if (regressions > 0) {
+        printf("\n%d regressions beyond %.0f%% (or failed runs)\n", regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
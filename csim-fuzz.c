@@ -0,0 +1,520 @@
+/*
+ * csim-fuzz.c - Differential fuzzing of the simulator. Every round picks
+ *     a random geometry and writes a random trace, then compares the
+ *     counts of csim, csim-ref, libcsim and a slow reference model
+ *     written here to be obviously right (one LRU list per set, no fast
+ *     paths). Geometries csim-ref cannot run (no set or offset bits,
+ *     huge blocks, sets and blocks that are not powers of two) are
+ *     checked against the reference model only. A trace that makes two
+ *     of them disagree is shrunk to a minimal one that still does, and
+ *     saved with the command lines that reproduce it.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "libcsim.h"
+
+/* Defaults for the command line */
+#define DEFAULT_ROUNDS 500
+#define DEFAULT_RECORDS 300
+#define FUZZ_DIR ".fuzz"
+
+/* Longest command line for csim */
+#define MAX_ARGS 40
+
+/* Where a geometry can be run */
+enum geometry_kind {
+    GEOMETRY_REF,                   /* s, E, b that csim-ref accepts too */
+    GEOMETRY_DIVIDE,                /* -S, -B that need not be powers of two */
+    GEOMETRY_LIBRARY,               /* s or b of 0 and very large b: libcsim only */
+    NUM_GEOMETRY_KINDS
+};
+
+/* The simulators that are compared */
+enum simulator { SIM_MODEL, SIM_CSIM, SIM_REF, SIM_LIBRARY, NUM_SIMULATORS };
+static const char* simulator_names[NUM_SIMULATORS] = {"model", "csim", "csim-ref", "libcsim"};
+
+struct geometry {
+    int kind;
+    int s, E, b;                    /* bits, for GEOMETRY_REF and GEOMETRY_LIBRARY */
+    unsigned long long S, B;        /* sets and block size, for GEOMETRY_DIVIDE */
+};
+
+struct record {
+    char op;
+    unsigned long long address;
+    int size;
+};
+
+struct counts {
+    long long hits, misses, evictions;
+};
+
+/* Options that reach csim, for trying its other code paths */
+static char* csim_args = NULL;
+
+/*
+ * next_random - xorshift64*
+ */
+static unsigned long long state = 1;
+static unsigned long long next_random()
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+/*
+ * below - Random number in [0, limit)
+ */
+static unsigned long long below(unsigned long long limit)
+{
+    return next_random() % limit;
+}
+
+/*
+ * random_geometry - Pick a geometry, with the edges (one set, one line
+ *     per set, one byte blocks, blocks as large as the address) often
+ */
+static struct geometry random_geometry()
+{
+    struct geometry g;
+    memset(&g, 0, sizeof(g));
+    g.kind = (int) below(NUM_GEOMETRY_KINDS);
+    switch (g.kind) {
+    case GEOMETRY_REF:
+        /* csim allocates the block bytes, so blocks stay small */
+        g.s = 1 + (int) below(below(4) == 0 ? 12 : 5);
+        g.E = 1 << below(5);
+        g.b = 1 + (int) below(8);
+        break;
+    case GEOMETRY_DIVIDE:
+        g.S = 2 + below(below(2) ? 8 : 200);
+        g.E = 1 << below(4);
+        /* a power of two block size lets libcsim run it too */
+        g.B = below(3) == 0 ? 1ULL << (1 + below(7)) : 2 + below(below(2) ? 16 : 200);
+        break;
+    default:
+        g.s = below(3) == 0 ? 0 : (int) below(11);
+        g.E = below(3) == 0 ? 1 : 1 + (int) below(20);
+        g.b = below(3) == 0 ? 0 : (int) below(below(2) ? 8 : 64 - g.s);
+        break;
+    }
+    return g;
+}
+
+/*
+ * random_trace - Records that hit, conflict and reach both ends of the
+ *     address space: a small pool of blocks that are reused, a walk,
+ *     addresses next to 0 and to the largest address, and anything
+ */
+static int random_trace(struct record* records, int max_records)
+{
+    unsigned long long pool[32];
+    int pool_size = 1 + (int) below(32);
+    int n = 1 + (int) below(max_records);
+    unsigned long long walk = next_random();
+    int i;
+
+    for (i = 0; i < pool_size; i++)
+        pool[i] = below(2) ? below(1ULL << (8 + below(24))) : next_random();
+    for (i = 0; i < n; i++) {
+        unsigned long long kind = below(100);
+        unsigned long long address;
+        if (kind < 45)
+            address = pool[below(pool_size)] + below(4) * below(64);
+        else if (kind < 60)
+            address = walk += 1 + below(64);
+        else if (kind < 72)
+            address = ~0ULL - below(below(2) ? 16 : 1 << 20);
+        else if (kind < 82)
+            address = below(below(2) ? 16 : 1 << 20);
+        else
+            address = next_random();
+        kind = below(100);
+        records[i].op = kind < 5 ? 'I' : (kind < 50 ? 'L' : (kind < 75 ? 'S' : 'M'));
+        records[i].address = address;
+        records[i].size = 1 + (int) below(8);
+    }
+    return n;
+}
+
+/*
+ * write_trace - Write the records as a valgrind style trace
+ */
+static int write_trace(const char* path, const struct record* records, int n)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+        return 0;
+    for (int i = 0; i < n; i++)
+        fprintf(fp, "%s%c %llx,%d\n", records[i].op == 'I' ? "" : " ", records[i].op, records[i].address,
+                records[i].size);
+    fclose(fp);
+    return 1;
+}
+
+/*
+ * run_model - The reference model: each set is a list of blocks from
+ *     most to least recently used, searched from the front
+ */
+static struct counts run_model(const struct geometry* g, const struct record* records, int n)
+{
+    struct counts c = {0, 0, 0};
+    unsigned long long sets, block_size;
+    int shift_sets = g->kind != GEOMETRY_DIVIDE;
+
+    if (shift_sets) {
+        sets = 1ULL << g->s;
+        block_size = 0;
+    } else {
+        sets = g->S;
+        block_size = g->B;
+    }
+    unsigned long long* blocks = malloc(sets * g->E * sizeof(unsigned long long));
+    int* used = calloc(sets, sizeof(int));
+
+    for (int i = 0; i < n; i++) {
+        if (records[i].op == 'I')
+            continue;
+        unsigned long long block = shift_sets ? records[i].address >> g->b : records[i].address / block_size;
+        unsigned long long set = block % sets;
+        unsigned long long* list = blocks + set * g->E;
+        for (int access = 0; access < (records[i].op == 'M' ? 2 : 1); access++) {
+            int found = -1;
+            for (int k = 0; k < used[set]; k++) {
+                if (list[k] == block) {
+                    found = k;
+                    break;
+                }
+            }
+            if (found >= 0) {
+                c.hits++;
+            } else {
+                c.misses++;
+                if (used[set] == g->E)
+                    c.evictions++;
+                else
+                    used[set]++;
+                found = used[set] - 1;
+            }
+            /* Move to the front; a miss drops the last (least recent) block */
+            memmove(list + 1, list, found * sizeof(unsigned long long));
+            list[0] = block;
+        }
+    }
+    free(blocks);
+    free(used);
+    return c;
+}
+
+/*
+ * run_library - Run the records through libcsim
+ */
+static int run_library(const struct geometry* g, const struct record* records, int n, struct counts* c)
+{
+    csim_config config = {g->s, g->E, g->b};
+    if (g->kind == GEOMETRY_DIVIDE)
+        config = (csim_config) {0, g->E, __builtin_ctzll(g->B), (long) g->S};
+    csim_handle* handle = csim_create(&config);
+    if (handle == NULL)
+        return 0;
+    addr_t* addresses = malloc(n * sizeof(addr_t) + 1);
+    uint8_t* ops = malloc(n + 1);
+    for (int i = 0; i < n; i++) {
+        addresses[i] = records[i].address;
+        ops[i] = (uint8_t) records[i].op;
+    }
+    csim_access_batch(handle, addresses, ops, n);
+    csim_counts counts = csim_stats(handle);
+    c->hits = counts.hits;
+    c->misses = counts.misses;
+    c->evictions = counts.evictions;
+    csim_destroy(handle);
+    free(addresses);
+    free(ops);
+    return 1;
+}
+
+/*
+ * command_line - The arguments of a simulator run on the trace
+ */
+static int command_line(int sim, const struct geometry* g, const char* trace, char* storage, char** argv)
+{
+    int argc = 0;
+    char* p = storage;
+
+    argv[argc++] = sim == SIM_REF ? "./csim-ref" : "./csim";
+    if (g->kind == GEOMETRY_DIVIDE)
+        p += sprintf(p, "-S %llu -E %d -B %llu", g->S, g->E, g->B) + 1;
+    else
+        p += sprintf(p, "-s %d -E %d -b %d", g->s, g->E, g->b) + 1;
+    if (sim == SIM_CSIM && csim_args != NULL)
+        sprintf(p, "%s", csim_args);
+    for (char* word = strtok(storage, " "); word != NULL && argc < MAX_ARGS - 3; word = strtok(NULL, " "))
+        argv[argc++] = word;
+    if (sim == SIM_CSIM && csim_args != NULL)
+        for (char* word = strtok(p, " "); word != NULL && argc < MAX_ARGS - 3; word = strtok(NULL, " "))
+            argv[argc++] = word;
+    argv[argc++] = "-t";
+    argv[argc++] = (char*) trace;
+    argv[argc] = NULL;
+    return argc;
+}
+
+/*
+ * run_program - Run csim or csim-ref on the trace and read its counts
+ *     from the "hits:" line of its output
+ */
+static int run_program(int sim, const struct geometry* g, const char* trace, struct counts* c)
+{
+    char storage[512], output[4096];
+    char* argv[MAX_ARGS];
+    int pipe_fds[2];
+    size_t length = 0;
+    ssize_t got;
+
+    command_line(sim, g, trace, storage, argv);
+    if (pipe(pipe_fds) != 0)
+        return 0;
+    pid_t pid = fork();
+    if (pid < 0)
+        return 0;
+    if (pid == 0) {
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        /* Both write .csim_results where they run */
+        if (chdir(FUZZ_DIR) == 0)
+            argv[0] = sim == SIM_REF ? "../csim-ref" : "../csim";
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    close(pipe_fds[1]);
+    while (length < sizeof(output) - 1 &&
+           (got = read(pipe_fds[0], output + length, sizeof(output) - 1 - length)) > 0)
+        length += got;
+    /* Drain the rest so a chatty run cannot block on a full pipe */
+    while (read(pipe_fds[0], storage, sizeof(storage)) > 0)
+        ;
+    close(pipe_fds[0]);
+    output[length] = '\0';
+
+    int status;
+    waitpid(pid, &status, 0);
+    char* line = strstr(output, "hits:");
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && line != NULL &&
+        sscanf(line, "hits:%lld misses:%lld evictions:%lld", &c->hits, &c->misses, &c->evictions) == 3;
+}
+
+/*
+ * simulate - Counts of one simulator, false if it could not run
+ */
+static int simulate(int sim, const struct geometry* g, const struct record* records, int n, struct counts* c)
+{
+    switch (sim) {
+    case SIM_MODEL:
+        *c = run_model(g, records, n);
+        return 1;
+    case SIM_LIBRARY:
+        return run_library(g, records, n, c);
+    default:
+        return write_trace(FUZZ_DIR "/fuzz.trace", records, n) && run_program(sim, g, "fuzz.trace", c);
+    }
+}
+
+/*
+ * applies - Whether a simulator can run a geometry
+ */
+static int applies(int sim, const struct geometry* g)
+{
+    switch (sim) {
+    case SIM_CSIM:
+        return g->kind != GEOMETRY_LIBRARY;
+    case SIM_REF:
+        return g->kind == GEOMETRY_REF;
+    case SIM_LIBRARY:
+        return g->kind != GEOMETRY_DIVIDE || (g->B & (g->B - 1)) == 0;
+    default:
+        return 1;
+    }
+}
+
+/*
+ * disagrees - Whether simulator sim gets different counts from the
+ *     model on these records (a simulator that fails counts as wrong)
+ */
+static int disagrees(int sim, const struct geometry* g, const struct record* records, int n)
+{
+    struct counts expected, got;
+    expected = run_model(g, records, n);
+    if (!simulate(sim, g, records, n, &got))
+        return 1;
+    return got.hits != expected.hits || got.misses != expected.misses || got.evictions != expected.evictions;
+}
+
+/*
+ * minimize - Delta debugging: drop ever smaller chunks of records as
+ *     long as sim still disagrees with the model, until no single
+ *     record can go. Returns the new number of records.
+ */
+static int minimize(int sim, const struct geometry* g, struct record* records, int n)
+{
+    struct record* trial = malloc(n * sizeof(struct record));
+    int chunk = n / 2;
+
+    while (chunk >= 1) {
+        int removed = 0;
+        for (int start = 0; start < n; ) {
+            int end = start + chunk < n ? start + chunk : n;
+            int m = 0;
+            for (int i = 0; i < n; i++)
+                if (i < start || i >= end)
+                    trial[m++] = records[i];
+            if (m > 0 && disagrees(sim, g, trial, m)) {
+                memcpy(records, trial, m * sizeof(struct record));
+                n = m;
+                removed = 1;
+            } else {
+                start = end;
+            }
+        }
+        if (!removed)
+            chunk /= 2;
+    }
+    free(trial);
+    return n;
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] [-n <rounds>] [-l <records>] [-s <seed>] [-a <csim options>] [-k]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h                Print this help message.\n");
+    printf("  -n <rounds>       Random geometries and traces to try (default %d)\n", DEFAULT_ROUNDS);
+    printf("  -l <records>      Most records per trace (default %d)\n", DEFAULT_RECORDS);
+    printf("  -s <seed>         Seed, to repeat a run (default the time)\n");
+    printf("  -a <options>      Extra options for csim that must not change its counts\n");
+    printf("  -k                Keep going after a failure\n");
+    printf("Example: %s -n 2000 -a \"--set-sample 1\"\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = DEFAULT_ROUNDS, max_records = DEFAULT_RECORDS;
+    unsigned long long seed = (unsigned long long) getpid() * 2654435761ULL ^ (unsigned long long) time(NULL);
+    int keep_going = 0, failures = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:l:s:a:kh")) != -1) {
+        switch (c) {
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        case 'l':
+            max_records = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'a':
+            csim_args = optarg;
+            break;
+        case 'k':
+            keep_going = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (rounds <= 0 || max_records <= 0) {
+        usage(argv);
+        exit(1);
+    }
+
+    mkdir(FUZZ_DIR, 0755);
+    struct record* records = malloc(max_records * sizeof(struct record));
+    if (records == NULL) {
+        printf("Error: Unable to allocate %d records\n", max_records);
+        exit(1);
+    }
+    printf("seed %llu\n", seed);
+
+    int compared[NUM_SIMULATORS] = {0};
+    for (int round = 0; round < rounds; round++) {
+        /* Each round can be replayed on its own from its seed */
+        state = (seed + round) * 0x9e3779b97f4a7c15ULL | 1;
+        for (int warm = 0; warm < 4; warm++)
+            next_random();
+        struct geometry g = random_geometry();
+        int n = random_trace(records, max_records);
+        struct counts expected = run_model(&g, records, n);
+
+        for (int sim = SIM_CSIM; sim < NUM_SIMULATORS; sim++) {
+            struct counts got;
+            if (!applies(sim, &g))
+                continue;
+            compared[sim]++;
+            int ran = simulate(sim, &g, records, n, &got);
+            if (ran && got.hits == expected.hits && got.misses == expected.misses &&
+                got.evictions == expected.evictions)
+                continue;
+
+            char storage[512];
+            char* args[MAX_ARGS];
+            char path[64];
+            failures++;
+            if (ran)
+                printf("round %d: %s hits:%lld misses:%lld evictions:%lld, model hits:%lld misses:%lld evictions:%lld\n",
+                       round, simulator_names[sim], got.hits, got.misses, got.evictions,
+                       expected.hits, expected.misses, expected.evictions);
+            else
+                printf("round %d: %s failed to run\n", round, simulator_names[sim]);
+            int before = n;
+            n = minimize(sim, &g, records, n);
+            snprintf(path, sizeof(path), "fuzz-%llu-%d.trace", seed, round);
+            write_trace(path, records, n);
+            expected = run_model(&g, records, n);
+            printf("    minimized from %d to %d records: %s\n", before, n, path);
+            printf("    model: hits:%lld misses:%lld evictions:%lld\n",
+                   expected.hits, expected.misses, expected.evictions);
+            if (sim == SIM_LIBRARY && g.kind == GEOMETRY_DIVIDE) {
+                printf("    libcsim: csim_create(&(csim_config) {0, %d, %d, %llu})\n",
+                       g.E, __builtin_ctzll(g.B), g.S);
+            } else if (sim == SIM_LIBRARY) {
+                printf("    libcsim: csim_create(&(csim_config) {%d, %d, %d})\n", g.s, g.E, g.b);
+            } else {
+                int count = command_line(sim == SIM_REF ? SIM_REF : SIM_CSIM, &g, path, storage, args);
+                printf("   ");
+                for (int i = 0; i < count; i++)
+                    printf(" %s", args[i]);
+                printf("\n");
+            }
+            if (!keep_going)
+                break;
+        }
+        if (failures > 0 && !keep_going)
+            break;
+    }
+
+    printf("%d failures; compared csim %d, csim-ref %d, libcsim %d times with the model\n",
+           failures, compared[SIM_CSIM], compared[SIM_REF], compared[SIM_LIBRARY]);
+    free(records);
+    return failures > 0;
+}
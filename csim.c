@@ -16,16 +16,42 @@
 
 //necessary include statements
 #include "cachelab.h"
+#include "profile.h"
+#include "prefetch.h"
+#include "tlb.h"
+#include "timing.h"
+#include "trace.h"
+#include "libcsim.h"
 #include <stdio.h>
 #include <getopt.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <math.h>
 #include <stdbool.h>
+#include <string.h>
 #include <strings.h>
 #include <sys/queue.h>
 
 
+//default number of accesses per working-set window in profiling mode
+#define DEFAULT_WS_WINDOW 10000
+
+//default number of trace records between two checkpoints
+#define DEFAULT_CHECKPOINT_EVERY 1000000
+
+//default prefetch degree and number of stream buffers
+#define DEFAULT_PREFETCH_DEGREE 2
+#define DEFAULT_STREAMS 8
+
+//default number of accesses a miss stays outstanding in an MSHR
+#define DEFAULT_MSHR_WINDOW 20
+
+//default TLB levels and page size
+#define DEFAULT_TLB_PAGE_SIZE "4k"
+
+//default memory bandwidth of the timing model, in bytes per cycle
+#define DEFAULT_BANDWIDTH 16.0
+
 //This custom data type is a 64 bit integer designed to hold
 //the (converted to binary) memory address that comes from the valgrind output
 typedef unsigned long long int memory_address;
@@ -47,9 +73,13 @@ typedef unsigned long long int memory_address;
 *						   and thus the number of elements contained in it are variable.
 *
 *
-*	int time_stamp	   	   used to denote the time at which a particular data element was accessed. Used to tell which lines
+*	long long time_stamp   used to denote the time at which a particular data element was accessed. Used to tell which lines
 *						   came in at what time and which element could be considered for candidacy as the least recently used
 *						   element.
+*
+*	int prefetched		   set when the line was filled by a prefetch and has not been demanded yet.
+*
+*	long long ready_time   access count at which a prefetch fill completes. A demand hit before then is a late prefetch.
 *	      
 *	========
 *	Returns
@@ -64,7 +94,9 @@ typedef struct {
 	int valid_bit;
 	memory_address tag;
 	char* block;
-	int time_stamp;
+	long long time_stamp;
+	int prefetched;
+	long long ready_time;
 } cache_set_line;
 
 /* Struct that defines a cache set
@@ -74,7 +106,7 @@ typedef struct {
 *	========
 *
 *	cache_set_line* 	   cache_lines pointer to a group of cache set lines. Depending on the value of E, 
-*						   this set will contain between 1-8 cache_set_lines per cache_set.
+*						   this set will contain E cache_set_lines per cache_set.
 *
 *	========
 *	Returns
@@ -97,6 +129,21 @@ typedef struct {
 *	cache_set* sets 	   pointer to the group of sets that composes the cache. Variable depending on the value of S
 *						   taken from the user at runtime.
 *
+*	memory_address* prefetch_victims	small table of blocks recently evicted by prefetch fills, used to tell when a
+*						   prefetch threw out a block that was demanded again (a polluting prefetch). NULL when
+*						   prefetching is off.
+*
+*	memory_address* victim_blocks	block address + 1 of each victim cache entry, 0 for an empty entry. The victim cache
+*						   is a small fully associative LRU buffer that catches every line evicted from the cache.
+*
+*	long long* victim_last_use	access count of the last time each victim cache entry was filled
+*
+*	int victim_size 	   number of victim cache entries, 0 when there is no victim cache
+*
+*	long long* mshr_ready  access count at which the miss held by each miss status holding register completes
+*
+*	int mshr_entries 	   number of miss status holding registers, 0 when misses are not modeled as outstanding
+*
 *	========
 *	Returns
 *	========
@@ -105,8 +152,37 @@ typedef struct {
 */
 typedef struct  {
 	cache_set* sets;
+	memory_address* prefetch_victims;
+	memory_address* victim_blocks;
+	long long* victim_last_use;
+	int victim_size;
+	long long* mshr_ready;
+	int mshr_entries;
 }cache;
 
+//number of entries in the table of blocks evicted by prefetches
+#define PREFETCH_VICTIMS 4096
+
+/* Struct that holds the precomputed reciprocal for dividing by a fixed divisor with a multiply and a shift (the
+*  round-up method of Granlund and Montgomery, as in libdivide), used for set counts and block sizes that are not powers
+*  of two.
+*
+*	========
+*	Members
+*	========
+*
+*	memory_address magic   the reciprocal, 0 when the divisor is a power of two and a shift does the division
+*
+*	int shift 			   right shift applied after the multiply
+*
+*	int add 			   set when the reciprocal needs a 65th bit, which the divide step adds back in
+*/
+typedef struct {
+	memory_address magic;
+	int shift;
+	int add;
+}divider;
+
 /* Struct to hold all of the parameters needed to construct the cache and determine number of hits and misses. 
 *
 *	========
@@ -124,11 +200,48 @@ typedef struct  {
 *
 *	int B 				   integer to hold the block size of blocks in the cache (given by 2^b)
 *
-*	int num_hits	       integer to hold the total number of hits when running a trace
+*	long long num_hits     integer to hold the total number of hits when running a trace
+*
+*	long long num_misses   integer to hold the total number of misses when running a trace
+*
+*	long long num_evictions integer to hold the total number of data evictions when running a trace
+*
+*	long long clock_base   accesses that were simulated but are not in the counts (time sampling warm-ups, earlier
+*						   libcsim batches); they still move the access clock on, see access_clock
+*
+*	int prefetch_latency   number of accesses a prefetch fill takes to arrive
+*
+*	long long prefetch_issued prefetch fills of blocks that were not already cached
+*
+*	long long prefetch_useful prefetched lines that were demanded before being evicted
+*
+*	long long prefetch_late useful prefetches whose fill had not arrived yet when the line was demanded
 *
-*	int num_misses		   integer to hold the total number of misses when running a trace
+*	long long prefetch_unused prefetched lines evicted without ever being demanded
 *
-*	int num_evictions	   integer to hold the total number of data evictions when running a trace
+*	long long prefetch_polluting demand misses on blocks that a prefetch fill had evicted
+*
+*	int mshr_window		   number of accesses a miss stays outstanding in its MSHR
+*
+*	long long victim_hits  misses that were found in the victim cache instead of going to memory
+*
+*	long long mshr_merged  accesses to a block whose miss was still outstanding, merged into its MSHR
+*
+*	long long mshr_stalls  misses that found every MSHR busy and had to wait for one
+*
+*	int index_scheme	   how an address picks its set: INDEX_MODULO (the plain bit slice), INDEX_XOR, INDEX_PRIME,
+*						   INDEX_SKEWED or INDEX_SLICED
+*
+*	int index_modulus	   largest prime not above S, the number of sets INDEX_PRIME uses
+*
+*	int slices			   number of slices INDEX_SLICED splits the sets into
+*
+*	divider block_divider  divides an address by B, for INDEX_DIVIDE
+*
+*	divider set_divider	   divides a block address by S, for INDEX_DIVIDE
+*
+*	unsigned int way_mask  ways the current access may fill (bit i for way i), set per record from its class of
+*						   service when the cache is partitioned; 0 lets a fill use every way
 *
 *	========
 *	Returns 
@@ -143,12 +256,106 @@ typedef struct  {
 	int E;
 	int b;
 	int B;
-	int num_hits;
-	int num_misses;
-	int num_evictions;
+	long long num_hits;
+	long long num_misses;
+	long long num_evictions;
+	long long clock_base;
+	int prefetch_latency;
+	long long prefetch_issued;
+	long long prefetch_useful;
+	long long prefetch_late;
+	long long prefetch_unused;
+	long long prefetch_polluting;
+	int mshr_window;
+	long long victim_hits;
+	long long mshr_merged;
+	long long mshr_stalls;
+	int index_scheme;
+	int index_modulus;
+	int slices;
+	divider block_divider;
+	divider set_divider;
+	unsigned int way_mask;
 }cache_stats;
 
+//most classes of service a partitioned cache can have
+#define MAX_CLASSES 16
+
+//set index functions. Every scheme but the plain bit slice uses all of the block address bits, so those caches keep
+//the whole block address as the tag.
+#define INDEX_MODULO 0
+#define INDEX_XOR    1
+#define INDEX_PRIME  2
+#define INDEX_SKEWED 3
+#define INDEX_SLICED 4
+//set count or block size that is not a power of two: block = address / B, set = block % S
+#define INDEX_DIVIDE 5
+
 
+/* Struct that holds the state of the sampled simulation modes. Set sampling simulates only a hash-selected subset of the
+*  sets and extrapolates; time sampling simulates a warm-up window followed by a measured window at the start of every
+*  period of records and skips the rest of the period without even parsing it. A single trace read in order skips by
+*  byte offset instead, so the skipped lines are not even looked at.
+*
+*	========
+*	Members
+*	========
+*
+*	int set_sample_rate 	   simulate one in set_sample_rate sets, 0 when set sampling is off
+*
+*	bool* set_sampled 	   per set flag, true when the set was selected for simulation
+*
+*	long long* set_accesses    per set number of simulated accesses, used for the confidence interval
+*
+*	long long* set_misses 	   per set number of misses
+*
+*	long long period, warmup, window	time sampling parameters in trace records, period is 0 when time sampling is off
+*
+*	long long records 	   number of trace records seen so far, including skipped ones
+*
+*	long long parsed_records   number of trace records that were parsed (not skipped by time sampling)
+*
+*	long long parsed_bytes	   bytes of the parsed records, which give the bytes per record a skip is sized by
+*
+*	long long skipped_bytes    bytes time sampling jumped over without reading them, 0 when it skips line by line
+*
+*	long long total_accesses   accesses seen (set sampling) or parsed (time sampling)
+*
+*	long long sampled_accesses accesses that were simulated and counted
+*
+*	long long window_accesses, window_misses	counters of the current time sampling window
+*
+*	long long windows 	   number of measured windows
+*
+*	double sum_a, sum_m, sum_aa, sum_mm, sum_am	running sums over the windows for the ratio estimator
+*/
+typedef struct {
+	int set_sample_rate;
+	bool* set_sampled;
+	long long* set_accesses;
+	long long* set_misses;
+	long long period;
+	long long warmup;
+	long long window;
+	long long records;
+	long long parsed_records;
+	long long parsed_bytes;
+	long long skipped_bytes;
+	long long total_accesses;
+	long long sampled_accesses;
+	long long window_accesses;
+	long long window_misses;
+	long long windows;
+	double sum_a;
+	double sum_m;
+	double sum_aa;
+	double sum_mm;
+	double sum_am;
+}sampling_state;
+
+
+//the library has no command line
+#ifndef CSIM_LIBRARY
 
 /* Function that prints out the usage options of the program to the user. Ends the program as this 
 *  only executes when the user inputs bad arguments or explicitly asks for help with the "-h" flag.
@@ -169,20 +376,100 @@ void usage (char* argv[])
 {
 	//go through and print out any relevant information for command line arguments
 	//to use the program
-    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("Usage: %s [-hvP] -s <num> -E <num> -b <num> -t <file> [-W <num>]\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
     printf("  -s <num>   Number of set index bits.\n");
     printf("  -E <num>   Number of lines per set.\n");
     printf("  -b <num>   Number of block offset bits.\n");
-    printf("  -t <file>  Trace file.\n");
+    printf("  -t <file>  Trace file, text or binary (synthtrace -B); repeat to replay several traces into one cache.\n");
+    printf("  -S <num>   Number of sets, instead of -s; need not be a power of two.\n");
+    printf("  -B <num>   Block size in bytes, instead of -b; need not be a power of two.\n");
+    printf("  -P, --profile\n");
+    printf("             Also print the reuse distance histogram, predicted miss\n");
+    printf("             ratio curve and working-set curve of the trace.\n");
+    printf("  -W, --ws-window <num>\n");
+    printf("             Accesses per working-set window (default %d).\n", DEFAULT_WS_WINDOW);
+    printf("  --set-sample <num>\n");
+    printf("             Simulate only a hashed one in <num> of the sets and\n");
+    printf("             extrapolate, with a 95%% confidence interval.\n");
+    printf("  --time-sample <period>,<warmup>,<window>\n");
+    printf("             In every <period> records, warm the cache for <warmup>\n");
+    printf("             records, measure <window> records and skip the rest.\n");
+    printf("  --prefetch <kind>[,<kind>...]\n");
+    printf("             Model hardware prefetchers: next-line, stride, stream.\n");
+    printf("  --prefetch-degree <num>\n");
+    printf("             Lines (next-line), strides (stride) or depth (stream) to\n");
+    printf("             fetch ahead (default %d).\n", DEFAULT_PREFETCH_DEGREE);
+    printf("  --streams <num>\n");
+    printf("             Number of stream buffers (default %d, max %d).\n", DEFAULT_STREAMS, MAX_STREAMS);
+    printf("  --prefetch-latency <num>\n");
+    printf("             Accesses until a prefetch fill arrives (default 0).\n");
+    printf("  --victim <num>\n");
+    printf("             Add a fully associative victim cache of <num> lines.\n");
+    printf("  --mshr <num>\n");
+    printf("             Model <num> miss status holding registers that merge\n");
+    printf("             accesses to a block whose miss is still outstanding.\n");
+    printf("  --mshr-window <num>\n");
+    printf("             Accesses a miss stays outstanding (default %d).\n", DEFAULT_MSHR_WINDOW);
+    printf("  --tlb <entries>:<ways>[,<entries>:<ways>]\n");
+    printf("             Model an L1 (and L2) TLB; page walks read the page table\n");
+    printf("             through the cache. Example: --tlb 64:4,1536:12\n");
+    printf("  --page-size <4k|2m|1g>\n");
+    printf("             Page size for the TLB model (default %s).\n", DEFAULT_TLB_PAGE_SIZE);
+    printf("  --l2 <s>,<E>,<b>\n");
+    printf("             Add a second level cache that L1 misses look up.\n");
+    printf("  --timing   Estimate cycles and AMAT with a blocking in-order core.\n");
+    printf("  --latency <name>=<cycles>[,...]\n");
+    printf("             Override latencies: l1, victim, l2, mem, tlb2\n");
+    printf("             (defaults 4, 6, 14, 200, 7). Implies --timing.\n");
+    printf("  --bandwidth <bytes>\n");
+    printf("             Memory bytes per cycle (default %.0f). Implies --timing.\n", DEFAULT_BANDWIDTH);
+    printf("  --index <modulo|xor|prime|skewed|slices:<n>>\n");
+    printf("             Set index function: plain bit slice (default), XOR-fold\n");
+    printf("             of the block address, modulo the largest prime set\n");
+    printf("             count, a different hash per way, or <n> hashed slices.\n");
+    printf("  --cat <mask>[,<mask>...]\n");
+    printf("             Partition the ways: class of service i may only fill\n");
+    printf("             the ways in the i-th hex mask. Records choose their\n");
+    printf("             class with a number after the size (\" L 10,4 1\").\n");
+    printf("  --class <num>\n");
+    printf("             Class of records that do not give one (default 0).\n");
+    printf("  --include <low>-<high>\n");
+    printf("             Simulate only accesses inside this hex address range\n");
+    printf("             (repeatable, either end may be left out).\n");
+    printf("  --exclude <low>-<high>\n");
+    printf("             Skip accesses inside this hex address range (repeatable).\n");
+    printf("  --markers <start>,<end>\n");
+    printf("             Simulate only from the first access to hex address\n");
+    printf("             <start> up to and including the next access to <end>.\n");
+    printf("  --records <first>-<last>\n");
+    printf("             Simulate only these L/S/M record indices (from 0).\n");
+    printf("  --ops <LSM>\n");
+    printf("             Simulate only the listed operation types.\n");
+    printf("  --schedule <rr|weighted:<w>[,<w>...]|timestamp>\n");
+    printf("             Interleave several traces one record each in turn (default),\n");
+    printf("             in proportion to the weights, or by the \"@<time>\" at\n");
+    printf("             the end of their records. Records without a class are in\n");
+    printf("             the class numbered after their trace.\n");
+    printf("  --parse-only\n");
+    printf("             Read and parse the trace without simulating it (for timing).\n");
+    printf("  --checkpoint <file>\n");
+    printf("             Periodically save the simulator state and trace position.\n");
+    printf("  --checkpoint-every <num>\n");
+    printf("             Trace records between checkpoints (default %d).\n", DEFAULT_CHECKPOINT_EVERY);
+    printf("  --resume <file>\n");
+    printf("             Continue the run saved in <file> and keep checkpointing to it.\n");
+    printf("  --warm-start <file>\n");
+    printf("             Start from the cache contents saved in <file> with zeroed counts.\n");
     printf("\nExamples:\n");
     printf("  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
     printf("  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
     //end the program
     exit(0);
 }
+#endif /* CSIM_LIBRARY */
 
 
 /*  Testing function to help debug the cache.  Useful for finding out which data entered which set/line based on tag.
@@ -226,7 +513,7 @@ void print_cache(cache the_cache, cache_stats cache_statistics){
 			//print out a delineating block
 			printf("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n");
 			//print out the current line's valid bit, tag, and time stamp
-			printf("Line %i's members: Valid Bit=%i, Tag=%llu, Time Stamp=%i\n", j, current_line.valid_bit, current_line.tag, current_line.time_stamp);
+			printf("Line %i's members: Valid Bit=%i, Tag=%llu, Time Stamp=%lld\n", j, current_line.valid_bit, current_line.tag, current_line.time_stamp);
 			//finishing delineating block
 			printf("++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n");
 		}
@@ -299,6 +586,13 @@ cache initialize_cache(long long num_sets, int associativity, long long block_si
 
 
 	constructed_cache.sets = (cache_set*) malloc(sizeof(cache_set) * num_sets);
+	//the prefetch victim table, victim cache and MSHRs are only set up when configured
+	constructed_cache.prefetch_victims = NULL;
+	constructed_cache.victim_blocks = NULL;
+	constructed_cache.victim_last_use = NULL;
+	constructed_cache.victim_size = 0;
+	constructed_cache.mshr_ready = NULL;
+	constructed_cache.mshr_entries = 0;
 
 	//Now that we have set the pointer in the cache object, we need to allocate lines to
 	//it.
@@ -327,6 +621,9 @@ cache initialize_cache(long long num_sets, int associativity, long long block_si
 			temp_cache_set_line.tag = 0;
 			//set the time_stamp of the line to 0 as it has not been accessed yet
 			temp_cache_set_line.time_stamp =0;
+			//nothing has been prefetched yet
+			temp_cache_set_line.prefetched = 0;
+			temp_cache_set_line.ready_time = 0;
 			//create a block of size block_size for each line
 			char* temp_block = (char*) malloc(sizeof(char*) * block_size);
 			//assign the block to the temp_cache_set_line
@@ -359,19 +656,19 @@ cache initialize_cache(long long num_sets, int associativity, long long block_si
 *
 *	cache_stats cache_statistics --> cache_stats object for grabbing the number of lines per set in order to iterate through all lines
 *
-*	int* time_stamp_container --> integer array that holds 2 elements: holds the most recently used element (representing value of the most current
+*	long long* time_stamp_container --> array that holds 2 elements: holds the most recently used element (representing value of the most current
 *								  time stamp) and the least recently used element (representing the value of time stamp of the least recently used element)
 *								  . These values need to be maintained and updated as elements are accessed and evicted.
 */
-int find_LRU_index(cache_set selected_set, cache_stats cache_statistics, int * time_stamp_container){
+int find_LRU_index(cache_set selected_set, cache_stats cache_statistics, long long* time_stamp_container){
 
 	//need to know the number of lines we have to loop through
 	int num_lines = cache_statistics.E;
 
 	//initialize both of these variables to value of the time stamp found in the set's
 	//first line
-	int highest_time_stamp = selected_set.cache_lines[0].time_stamp; //will be used by run_simulation to set other lines' time stamps
-	int lowest_time_stamp = selected_set.cache_lines[0].time_stamp; //used to find current the lowest time stamp
+	long long highest_time_stamp = selected_set.cache_lines[0].time_stamp; //will be used by run_simulation to set other lines' time stamps
+	long long lowest_time_stamp = selected_set.cache_lines[0].time_stamp; //used to find current the lowest time stamp
 
 	//variable that will be returned after logic checks
 	int lowest_time_stamp_index = 0;
@@ -506,205 +803,2029 @@ int find_empty_line(cache_set selected_set, cache_stats cache_statistics){
 
 
 
-/* Function to simulate accesses to the cache. Causes changes in statistical data regarding hits, misses, and evictions. 
-*  Takes in a memory address corresponding to the incoming data, attempts to find that item in the cache. If so, it was a hit. Otherwise, it was
-*  a miss or an eviction. If it was a cold miss, the data item is stored in the cache.
-*  The function performs evictions based on least recently used element, and as such needs to keep track of and
-*  update time stamps for data elements in the cache as well. 
-*  Once the function has completed determining hits, misses, or evictions, it returns a cache_stats object that is used by main
-*  to report the total number of hits, misses, and evictions to standard out.
+/* Function to set up division by a fixed divisor.
 *
 *	=========
 *	Arguments
 *	=========
 *
-*	cache main_cache --> the complete cache object that data passes through and is evaluated on hits, misses, and evictions
-*
-*	cache_stats cache_statistics --> cache_stats object that is used to hold the relevant statistical information for reporting
-*									 hits, misses, and evictions. Also contains data members for S, s, E, b, and B.
-*
-*	memory_address address --> 64 bit memory address that represents an incoming data item into the cache. The data item is 
-*							   tried against the cache, where it is evaluated as a hit, miss, or it evicts another data item.
+*	memory_address divisor --> the divisor, at least 1
 *
 *	=======
 *	Returns
 *	=======
-*	
-*	cache_stats object, updated based on the number of hits, misses, and evictions that occurred during evaluation of
-*	an incoming data item. 
+*
+*	divider, the reciprocal and shift
 */
-cache_stats run_simulation(cache main_cache, cache_stats cache_statistics, memory_address address){
-
-	//need some variables to hold some statistical information
-
-	//need a variable that tells us if the cache is full or not
-	int line_is_full = 1;
-
-	//need a variable to hold the number of lines that we are dealing with from the cache
-	int num_lines = cache_statistics.E;
-
-	//need to keep track of the previous number of hits so that it increases when hit occurs
-	int previous_hits = cache_statistics.num_hits;
-
-	//need to know the size of the tag given the parameters that were passed in by the user.
-	//This is found by taking the size of a memory address (64 bits) and decreasing this value
-	//by the value of the number of set bits and by the value of the number of block bits
-	int tag_size = (64 - (cache_statistics.s + cache_statistics.b));
-
-	//printf("Tag Size: %i\n", tag_size);
-
-	//We need a way to find which set the new data is trying to fit into (i.e. the index of the set).
-	//To do this, we can do some clever bit shifting.
-
-	//Let's assume the following parameters:
-
-	//+-------------------------------------------------------------+
-	//| tag bits (48)   | set index bits (8) | byte offset bits (8) |
-	//+-------------------------------------------------------------+
-
-	//To get the set index by itself, first we can left shift by the value of the tag bits to get rid of them (48 in this case):
-
-	//+------------------------------------------------------------------------+
-	//| set index(8)   | block offset bits(8) | a bunch of 0's (tag size = 48) |
-	//+------------------------------------------------------------------------+
-
-	//Then, we can right shift the whole thing by (tag size + byte offset) to get the set index in the least significant position:
+divider make_divider(memory_address divisor){
+	divider result = {0, 0, 0};
+	int floor_log2 = 63 - __builtin_clzll(divisor);
+	if ((divisor & (divisor - 1)) == 0){
+		result.shift = floor_log2;
+		return result;
+	}
+	//2^(64 + floor_log2) / divisor, and its remainder
+	unsigned __int128 numerator = (unsigned __int128) 1 << (64 + floor_log2);
+	memory_address proposed = (memory_address) (numerator / divisor);
+	memory_address remainder = (memory_address) (numerator % divisor);
+	if (divisor - remainder < ((memory_address) 1 << floor_log2)){
+		//the reciprocal rounded up fits in 64 bits
+		result.shift = floor_log2;
+	}
+	else {
+		//one more bit of precision: the 65 bit reciprocal 2^64 + magic
+		proposed += proposed;
+		memory_address twice_remainder = remainder + remainder;
+		if (twice_remainder >= divisor || twice_remainder < remainder){
+			proposed++;
+		}
+		result.shift = floor_log2;
+		result.add = 1;
+	}
+	result.magic = proposed + 1;
+	return result;
+}
 
-	//+------------------------------------------------------------------------+
-	//| a bunch of 0's (tag size + block offset = 8 + 48 = 56) | set index(8)  |
-	//+------------------------------------------------------------------------+
 
-	//Which leaves us with the set index
+/* Function to divide by the divisor a divider was made for.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	memory_address dividend --> the number to divide
+*
+*	divider by --> the precomputed divider
+*
+*	=======
+*	Returns
+*	=======
+*
+*	memory_address, dividend / divisor rounded down
+*/
+memory_address divide(memory_address dividend, divider by){
+	if (by.magic == 0){
+		return dividend >> by.shift;
+	}
+	memory_address quotient = (memory_address) (((unsigned __int128) dividend * by.magic) >> 64);
+	if (by.add){
+		return (((dividend - quotient) >> 1) + quotient) >> by.shift;
+	}
+	return quotient >> by.shift;
+}
 
-	//First, we will left shift the passed in address by the size of the tag in order to strip off the tag bits.
-	memory_address left_shifted_temp = address << (tag_size);
 
-	//Next, we will right shift the left_shifted_temp variable by (tag_size + number of block offset bits) in order
-	//to recover the set index
-	memory_address set_index = left_shifted_temp >> (tag_size + cache_statistics.b);
+/* Function to find the block address (address / B) of an address.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache_stats cache_statistics --> cache_stats object holding b or the block divider
+*
+*	memory_address address --> the 64 bit address being accessed
+*
+*	=======
+*	Returns
+*	=======
+*
+*	memory_address, the block address
+*/
+memory_address find_block(cache_stats cache_statistics, memory_address address){
+	if (cache_statistics.index_scheme == INDEX_DIVIDE){
+		return divide(address, cache_statistics.block_divider);
+	}
+	return address >> cache_statistics.b;
+}
 
-	//Next, in order to determine if our data is already in the cache, we need to know what the tag is for the
-	//incoming data. We can get the tag bits from the memory address by right shifting the memory address by (set bits + block offset bits):
-	memory_address incoming_tag = address >> (cache_statistics.s + cache_statistics.b);
 
-	//Now that we know which set we are trying to put data in, we need to hold it in a variable
-	cache_set selected_set = main_cache.sets[set_index];
+/* Function to find the line a fill goes to when the cache is partitioned: the first empty way the access's class may
+*  use, otherwise the least recently used of those ways.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache_set selected_set --> the set the block maps to
+*
+*	cache_stats cache_statistics --> holds E and the way mask of the access
+*
+*	int* evict --> set to 1 if the line returned holds a block that has to be evicted, 0 if it is empty
+*
+*	=======
+*	Returns
+*	=======
+*
+*	integer, the index of the line to fill
+*/
+int find_partition_line(cache_set selected_set, cache_stats cache_statistics, int* evict){
+	int lru_index = -1;
+	for (int i = 0; i < cache_statistics.E; i++){
+		if (!(cache_statistics.way_mask & (1u << i))){
+			continue;
+		}
+		if (!selected_set.cache_lines[i].valid_bit){
+			*evict = 0;
+			return i;
+		}
+		if (lru_index < 0 || selected_set.cache_lines[i].time_stamp < selected_set.cache_lines[lru_index].time_stamp){
+			lru_index = i;
+		}
+	}
+	*evict = 1;
+	return lru_index;
+}
 
-	//Now we have a set that we can try and put data in, and a tag associated with the incoming data. Now we need to loop through
-	//all of the lines in the selected set and determine if the data is in the cache.
 
-	for (int i=0; i < num_lines; i++){
-		//grab the current line under consideration
-		cache_set_line current_line = selected_set.cache_lines[i];
-		//if the current line is valid, then there is data in it and needs to be looked at
-		if(current_line.valid_bit){
-			//if the current line's tag and the incoming tag are identical, then the data was in the cache.
-			if(current_line.tag == incoming_tag){
-				//increment the number of hits
-				cache_statistics.num_hits++;
-				
-				//data was accessed, increment the number of accesses
-				current_line.time_stamp++;
-				//since we modified the members of the line, we need to reflect that in the selected_set
-				selected_set.cache_lines[i] = current_line;
+/* Function to compute a hashed set index.
+*
+*	INDEX_XOR     XOR-folds every s bit chunk of the block address into the set index.
+*	INDEX_PRIME   takes the block address modulo the largest prime not above S; the sets above it stay unused.
+*	INDEX_SKEWED  gives every way its own hash (a skewed-associative cache), so blocks that collide in one way are
+*	              likely to be apart in the others.
+*	INDEX_SLICED  picks a slice the way sliced last level caches do, from the parity of a different subset of the block
+*	              address bits for each slice bit, then the set within the slice from the low bits.
+*	INDEX_DIVIDE  the block address modulo S, with the division done by multiplying with a reciprocal.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache_stats cache_statistics --> cache_stats object holding s and the index scheme
+*
+*	memory_address block --> block address (address >> b)
+*
+*	int way --> the way being looked at, only used by INDEX_SKEWED
+*
+*	=======
+*	Returns
+*	=======
+*
+*	memory_address, the set index
+*/
+memory_address hashed_set_index(cache_stats cache_statistics, memory_address block, int way){
+	memory_address mask = ((memory_address) 1 << cache_statistics.s) - 1;
+	switch (cache_statistics.index_scheme){
+		case INDEX_XOR: {
+			memory_address index = 0;
+			for (memory_address rest = block; rest != 0; rest = cache_statistics.s > 0 ? rest >> cache_statistics.s : 0){
+				index ^= rest & mask;
 			}
-
+			return index;
 		}
-		//We looked at the line and the line was not valid (i.e. empty), that means the data was not in the cache. 
-		if(current_line.valid_bit != 1)
-		{
-			//This also means that the cache was not full, so change the cache_is_full flag to false
-			if (line_is_full){
-				//printf("Someone's valid bit was 0, cache is not full\n");
-				line_is_full = 0;
-
+		case INDEX_PRIME:
+			return block % (memory_address) cache_statistics.index_modulus;
+		case INDEX_DIVIDE:
+			return block - divide(block, cache_statistics.set_divider) * (memory_address) cache_statistics.S;
+		case INDEX_SKEWED: {
+			//splitmix64 finalizer, seeded differently for each way
+			memory_address hash = block + 0x9E3779B97F4A7C15ULL * (memory_address) (way + 1);
+			hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+			return (hash ^ (hash >> 31)) & mask;
+		}
+		case INDEX_SLICED: {
+			int slice_bits = 0;
+			while ((1 << slice_bits) < cache_statistics.slices){
+				slice_bits++;
 			}
-			
+			int local_bits = cache_statistics.s - slice_bits;
+			memory_address slice = 0;
+			for (int k = 0; k < slice_bits; k++){
+				//each slice bit is the parity of the block address bits selected by a fixed mask
+				memory_address selected = block & (0x5B5A5A5A5AD6B5ADULL * (memory_address) (2 * k + 1));
+				slice |= (memory_address) __builtin_parityll(selected) << k;
+			}
+			return (slice << local_bits) | (block & (((memory_address) 1 << local_bits) - 1));
 		}
-		
-		
-	
+		default:
+			return block & mask;
 	}
+}
 
-	//We have looked through all lines in the set. now we want to see if the number of hits was incremented by comparing the data
-	//member of cache_statistics with our variable previous_hits. If it was, we had a cache hit and we should return the cache_statistics 
-	//object. If not, then we know it was a miss and we need to do some more processing.
-	if(cache_statistics.num_hits == previous_hits){
-		//this means that hits was not incremented and was thus a miss. Increment number of misses and process more.
-		cache_statistics.num_misses++;
+
+/* Function to find which set an address maps to. Uses the same bit slicing as run_simulation: strip the tag bits with
+*  a left shift, then shift the set index bits down to the least significant position.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache_stats cache_statistics --> cache_stats object holding s and b
+*
+*	memory_address address --> the 64 bit address being accessed
+*
+*	=======
+*	Returns
+*	=======
+*
+*	memory_address, the index of the set the address maps to
+*/
+memory_address find_set_index(cache_stats cache_statistics, memory_address address){
+	if (cache_statistics.index_scheme != INDEX_MODULO){
+		return hashed_set_index(cache_statistics, find_block(cache_statistics, address), 0);
 	}
-	else {
-		//the number of hits was incremented, and we had a hit. Return the cache_statistics object.
-		return cache_statistics;
+	//a shift by 64 is undefined, and with no set bits there is only set 0
+	if (cache_statistics.s == 0){
+		return 0;
 	}
+	int tag_size = (64 - (cache_statistics.s + cache_statistics.b));
+	return (address << tag_size) >> (tag_size + cache_statistics.b);
+}
 
-	//Now that we have gone this far, we had a cache miss. 
-
-	//We need to know the counts of the least used line and the most used counts. To do this, we will 
-	//declare ourselves an int* that holds 2 elements: 
-	//arr[0] will contain the count of the most used line
-	//arr[1] will contain the count of the least used line. 
-	//We need these values because they will change as we continually try and find the least used element in order
-	//to replace it.
-
-	int* time_stamp_container = (int*) malloc(sizeof(int*) * 2);
-
-	//When an
+
+/* Function to find the tag an address is stored under: the bits above the set index for the plain bit slice, the whole
+*  block address for the hashed index functions.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache_stats cache_statistics --> cache_stats object holding s, b and the index scheme
+*
+*	memory_address address --> the 64 bit address being accessed
+*
+*	=======
+*	Returns
+*	=======
+*
+*	memory_address, the tag
+*/
+memory_address find_tag(cache_stats cache_statistics, memory_address address){
+	if (cache_statistics.index_scheme != INDEX_MODULO){
+		return find_block(cache_statistics, address);
+	}
+	return address >> (cache_statistics.s + cache_statistics.b);
+}
+
+
+/* Function to recover the block address (address >> b) held by a line from its tag and set.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache_stats cache_statistics --> cache_stats object holding s and the index scheme
+*
+*	memory_address tag --> the tag of the line
+*
+*	memory_address set_index --> the set the line is in
+*
+*	=======
+*	Returns
+*	=======
+*
+*	memory_address, the block address
+*/
+memory_address line_block(cache_stats cache_statistics, memory_address tag, memory_address set_index){
+	if (cache_statistics.index_scheme != INDEX_MODULO){
+		return tag;
+	}
+	return (tag << cache_statistics.s) | set_index;
+}
+
+
+/* Function to look a block up in the victim cache. A block that is found is taken out, since it moves back into the
+*  cache.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache the_cache --> the cache whose victim cache is searched
+*
+*	memory_address block --> the block address (address >> b)
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, true if the victim cache held the block
+*/
+bool victim_lookup(cache the_cache, memory_address block){
+	for (int i = 0; i < the_cache.victim_size; i++){
+		if (the_cache.victim_blocks[i] == block + 1){
+			the_cache.victim_blocks[i] = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/* Function to put a line evicted from the cache into the victim cache, replacing an empty or the least recently
+*  filled entry.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache the_cache --> the cache whose victim cache is filled
+*
+*	memory_address block --> the evicted block address (address >> b)
+*
+*	long long now --> current access count
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+void victim_insert(cache the_cache, memory_address block, long long now){
+	int replace = 0;
+	for (int i = 0; i < the_cache.victim_size; i++){
+		if (the_cache.victim_blocks[i] == 0){
+			replace = i;
+			break;
+		}
+		if (the_cache.victim_last_use[i] < the_cache.victim_last_use[replace]){
+			replace = i;
+		}
+	}
+	the_cache.victim_blocks[replace] = block + 1;
+	the_cache.victim_last_use[replace] = now;
+}
+
+
+/* Function to allocate a miss status holding register for a miss that goes to memory. If every register is still
+*  busy the miss waits for the one that frees up first.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache the_cache --> the cache whose MSHRs are used
+*
+*	cache_stats* cache_statistics --> counts the stall and holds the MSHR window
+*
+*	long long now --> current access count
+*
+*	=======
+*	Returns
+*	=======
+*
+*	long long, access count at which the miss completes
+*/
+long long mshr_allocate(cache the_cache, cache_stats* cache_statistics, long long now){
+	//the register that frees up first
+	int earliest = 0;
+	for (int i = 1; i < the_cache.mshr_entries; i++){
+		if (the_cache.mshr_ready[i] < the_cache.mshr_ready[earliest]){
+			earliest = i;
+		}
+	}
+	long long start = now;
+	if (the_cache.mshr_ready[earliest] > now){
+		//every register holds an outstanding miss
+		cache_statistics->mshr_stalls++;
+		start = the_cache.mshr_ready[earliest];
+	}
+	the_cache.mshr_ready[earliest] = start + cache_statistics->mshr_window;
+	return the_cache.mshr_ready[earliest];
+}
+
+
+/* Function to read the access clock: the number of accesses simulated so far, counted or not. Time stamps, prefetch
+*  fills and outstanding misses are timed with it, so it has to keep running through accesses that are not counted.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache_stats cache_statistics --> the running counts
+*
+*	=======
+*	Returns
+*	=======
+*
+*	long long, the accesses simulated before the current one
+*/
+static inline long long access_clock(cache_stats cache_statistics){
+	return cache_statistics.num_hits + cache_statistics.num_misses + cache_statistics.clock_base;
+}
+
+
+/* Function to simulate one access to a skewed-associative cache. Way w of the block lives in set
+*  hashed_set_index(block, w), so each access looks at one line in each of E different sets and replaces the least
+*  recently used of those E lines. Time stamps come from the access count, since the lines compared are in different sets.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache main_cache --> the complete cache object
+*
+*	cache_stats cache_statistics --> the running counts and the geometry
+*
+*	memory_address address --> the address being accessed
+*
+*	=======
+*	Returns
+*	=======
+*
+*	cache_stats object updated with this access
+*/
+cache_stats skewed_simulation(cache main_cache, cache_stats cache_statistics, memory_address address){
+	memory_address block = address >> cache_statistics.b;
+	long long stamp = access_clock(cache_statistics) + 1;
+	cache_set_line* replace = NULL;
+	for (int way = 0; way < cache_statistics.E; way++){
+		cache_set_line* line = &main_cache.sets[hashed_set_index(cache_statistics, block, way)].cache_lines[way];
+		if (line->valid_bit && line->tag == block){
+			cache_statistics.num_hits++;
+			line->time_stamp = stamp;
+			return cache_statistics;
+		}
+		//an empty line first, otherwise the least recently used one
+		if (replace == NULL || (replace->valid_bit && (!line->valid_bit || line->time_stamp < replace->time_stamp))){
+			replace = line;
+		}
+	}
+	cache_statistics.num_misses++;
+	cache_statistics.num_evictions += replace->valid_bit;
+	replace->valid_bit = 1;
+	replace->tag = block;
+	replace->time_stamp = stamp;
+	return cache_statistics;
+}
+
+
+/* Function to simulate accesses to the cache. Causes changes in statistical data regarding hits, misses, and evictions. 
+*  Takes in a memory address corresponding to the incoming data, attempts to find that item in the cache. If so, it was a hit. Otherwise, it was
+*  a miss or an eviction. If it was a cold miss, the data item is stored in the cache.
+*  The function performs evictions based on least recently used element, and as such needs to keep track of and
+*  update time stamps for data elements in the cache as well. 
+*  Once the function has completed determining hits, misses, or evictions, it returns a cache_stats object that is used by main
+*  to report the total number of hits, misses, and evictions to standard out.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache main_cache --> the complete cache object that data passes through and is evaluated on hits, misses, and evictions
+*
+*	cache_stats cache_statistics --> cache_stats object that is used to hold the relevant statistical information for reporting
+*									 hits, misses, and evictions. Also contains data members for S, s, E, b, and B.
+*
+*	memory_address address --> 64 bit memory address that represents an incoming data item into the cache. The data item is 
+*							   tried against the cache, where it is evaluated as a hit, miss, or it evicts another data item.
+*
+*	=======
+*	Returns
+*	=======
+*	
+*	cache_stats object, updated based on the number of hits, misses, and evictions that occurred during evaluation of
+*	an incoming data item. 
+*/
+cache_stats run_simulation(cache main_cache, cache_stats cache_statistics, memory_address address){
+
+	//a skewed cache does not look in a single set
+	if (cache_statistics.index_scheme == INDEX_SKEWED){
+		return skewed_simulation(main_cache, cache_statistics, address);
+	}
+
+	//need some variables to hold some statistical information
+
+	//number of accesses before this one, used as the clock for prefetch fills and outstanding misses
+	long long now = access_clock(cache_statistics);
+
+	//need a variable that tells us if the cache is full or not
+	int line_is_full = 1;
+
+	//need a variable to hold the number of lines that we are dealing with from the cache
+	int num_lines = cache_statistics.E;
+
+	//need to keep track of the previous number of hits so that it increases when hit occurs
+	long long previous_hits = cache_statistics.num_hits;
+
+	//line that hit, and the newest time stamp in the set, so a hit line becomes the most recently used one
+	int hit_index = -1;
+	long long highest_time_stamp = 0;
+
+	//need to know the size of the tag given the parameters that were passed in by the user.
+	//This is found by taking the size of a memory address (64 bits) and decreasing this value
+	//by the value of the number of set bits and by the value of the number of block bits
+	int tag_size = (64 - (cache_statistics.s + cache_statistics.b));
+
+	//printf("Tag Size: %i\n", tag_size);
+
+	//We need a way to find which set the new data is trying to fit into (i.e. the index of the set).
+	//To do this, we can do some clever bit shifting.
+
+	//Let's assume the following parameters:
+
+	//+-------------------------------------------------------------+
+	//| tag bits (48)   | set index bits (8) | byte offset bits (8) |
+	//+-------------------------------------------------------------+
+
+	//To get the set index by itself, first we can left shift by the value of the tag bits to get rid of them (48 in this case):
+
+	//+------------------------------------------------------------------------+
+	//| set index(8)   | block offset bits(8) | a bunch of 0's (tag size = 48) |
+	//+------------------------------------------------------------------------+
+
+	//Then, we can right shift the whole thing by (tag size + byte offset) to get the set index in the least significant position:
+
+	//+------------------------------------------------------------------------+
+	//| a bunch of 0's (tag size + block offset = 8 + 48 = 56) | set index(8)  |
+	//+------------------------------------------------------------------------+
+
+	//Which leaves us with the set index
+
+	//With no set bits every address is in set 0; the shifts below would then be by 64, which C leaves undefined
+	//(x86 shifts by 0 instead and picks a set far outside the cache).
+	memory_address set_index = 0;
+	if (cache_statistics.s > 0){
+		//First, we will left shift the passed in address by the size of the tag in order to strip off the tag bits.
+		memory_address left_shifted_temp = address << (tag_size);
+
+		//Next, we will right shift the left_shifted_temp variable by (tag_size + number of block offset bits) in order
+		//to recover the set index
+		set_index = left_shifted_temp >> (tag_size + cache_statistics.b);
+	}
+
+	//Next, in order to determine if our data is already in the cache, we need to know what the tag is for the
+	//incoming data. We can get the tag bits from the memory address by right shifting the memory address by (set bits + block offset bits):
+	memory_address incoming_tag = address >> (cache_statistics.s + cache_statistics.b);
+
+	//the hashed index functions pick the set from all of the block address bits, so the tag has to keep all of them
+	if (cache_statistics.index_scheme != INDEX_MODULO){
+		set_index = find_set_index(cache_statistics, address);
+		incoming_tag = find_tag(cache_statistics, address);
+	}
+
+	//Now that we know which set we are trying to put data in, we need to hold it in a variable
+	cache_set selected_set = main_cache.sets[set_index];
+
+	//Now we have a set that we can try and put data in, and a tag associated with the incoming data. Now we need to loop through
+	//all of the lines in the selected set and determine if the data is in the cache.
+
+	for (int i=0; i < num_lines; i++){
+		//grab the current line under consideration
+		cache_set_line current_line = selected_set.cache_lines[i];
+		//if the current line is valid, then there is data in it and needs to be looked at
+		if(current_line.valid_bit){
+			//if the current line's tag and the incoming tag are identical, then the data was in the cache.
+			if(current_line.tag == incoming_tag){
+				//first demand for a prefetched line: the prefetch was useful, and late if its fill was still on the way
+				if(current_line.prefetched){
+					cache_statistics.prefetch_useful++;
+					if(current_line.ready_time > access_clock(cache_statistics)){
+						cache_statistics.prefetch_late++;
+					}
+					current_line.prefetched = 0;
+				}
+				//a demand miss on this block is still outstanding, this access merges into its MSHR
+				else if(current_line.ready_time > now){
+					cache_statistics.mshr_merged++;
+				}
+				//increment the number of hits
+				cache_statistics.num_hits++;
+				hit_index = i;
+				//since we modified the members of the line, we need to reflect that in the selected_set
+				selected_set.cache_lines[i] = current_line;
+			}
+			if(current_line.time_stamp > highest_time_stamp){
+				highest_time_stamp = current_line.time_stamp;
+			}
+
+		}
+		//We looked at the line and the line was not valid (i.e. empty), that means the data was not in the cache. 
+		if(current_line.valid_bit != 1)
+		{
+			//This also means that the cache was not full, so change the cache_is_full flag to false
+			if (line_is_full){
+				//printf("Someone's valid bit was 0, cache is not full\n");
+				line_is_full = 0;
+
+			}
+			
+		}
+		
+		
+	
+	}
+
+	//We have looked through all lines in the set. now we want to see if the number of hits was incremented by comparing the data
+	//member of cache_statistics with our variable previous_hits. If it was, we had a cache hit and we should return the cache_statistics 
+	//object. If not, then we know it was a miss and we need to do some more processing.
+	if(cache_statistics.num_hits == previous_hits){
+		//this means that hits was not incremented and was thus a miss. Increment number of misses and process more.
+		cache_statistics.num_misses++;
+		//a miss on a block a prefetch fill threw out means the prefetch polluted the cache
+		if(main_cache.prefetch_victims != NULL){
+			memory_address block = find_block(cache_statistics, address);
+			memory_address* victim = &main_cache.prefetch_victims[block % PREFETCH_VICTIMS];
+			if(*victim == block + 1){
+				cache_statistics.prefetch_polluting++;
+				*victim = 0;
+			}
+		}
+	}
+	else {
+		//the number of hits was incremented, and we had a hit. The line was just used, so it gets the newest time
+		//stamp in the set; adding one to its own stamp could leave it older than lines filled after it.
+		selected_set.cache_lines[hit_index].time_stamp = highest_time_stamp + 1;
+		//Return the cache_statistics object.
+		return cache_statistics;
+	}
+
+	//Now that we have gone this far, we had a cache miss. 
+
+	//We need to know the counts of the least used line and the most used counts. To do this, we will 
+	//declare ourselves an int* that holds 2 elements: 
+	//arr[0] will contain the count of the most used line
+	//arr[1] will contain the count of the least used line. 
+	//We need these values because they will change as we continually try and find the least used element in order
+	//to replace it.
+
+	long long* time_stamp_container = (long long*) malloc(sizeof(long long) * 2);
+
+	//When an
 
 	//Now that we have a structure that we can hold our MRU and LRU values, we need to find the index of the line
 	//in the set that contains the LRU element
 
-	int LRU_index = find_LRU_index(selected_set, cache_statistics, time_stamp_container);
+	int LRU_index = find_LRU_index(selected_set, cache_statistics, time_stamp_container);
+
+	//in a partitioned cache the block may only go to its class's ways, which might be full while other ways are empty
+	if (cache_statistics.way_mask != 0){
+		LRU_index = find_partition_line(selected_set, cache_statistics, &line_is_full);
+	}
+
+	//the missing block comes back from the victim cache if it is there, otherwise from memory through an MSHR
+	long long fill_ready_time = now;
+	if (main_cache.victim_size > 0 && victim_lookup(main_cache, find_block(cache_statistics, address))){
+		cache_statistics.victim_hits++;
+	}
+	else if (main_cache.mshr_entries > 0){
+		fill_ready_time = mshr_allocate(main_cache, &cache_statistics, now);
+	}
+
+	//Now that we have the index of the least recently used element, we need to deal with the cases
+	//of either:
+	//
+	//The cache was full and we need to evict
+	//
+	//The cache was not full and we can store the line in cache
+
+	//Case 1: cache was full and we need to evict
+	if (line_is_full){
+		//we need to evict someone from the cache
+
+		//first we increment the eviction counter
+		cache_statistics.num_evictions++;
+
+		//a prefetched line that leaves before it was ever demanded was a wasted prefetch
+		if(selected_set.cache_lines[LRU_index].prefetched){
+			cache_statistics.prefetch_unused++;
+			selected_set.cache_lines[LRU_index].prefetched = 0;
+		}
+		//the evicted line drops into the victim cache
+		if(main_cache.victim_size > 0){
+			victim_insert(main_cache, line_block(cache_statistics, selected_set.cache_lines[LRU_index].tag, set_index), now);
+		}
+		selected_set.cache_lines[LRU_index].ready_time = fill_ready_time;
+
+		//next we need to evict someone, so we set the tag in the cache at the LRU_index to be the tag of the
+		//incoming data
+		selected_set.cache_lines[LRU_index].tag = incoming_tag;
+
+		//now we modify the time stamp of the element in the line to reflect its access time, which is 
+		//the highest current time stamp + 1
+		selected_set.cache_lines[LRU_index].time_stamp = time_stamp_container[1] + 1;
+		//store the selected set in the cache at the set_index position
+		main_cache.sets[set_index] = selected_set;
+	}
+	//else there was room in the cache and we just need to find a line in the selected set to put it in
+	else {
+
+		//get the index of an empty line in the currently selected cache set
+		int empty_line_index = cache_statistics.way_mask != 0 ? LRU_index : find_empty_line(selected_set, cache_statistics);
+
+		//printf("there was room in the cache");
+
+		//set the tag of the empty line with the tag of the incoming data
+		selected_set.cache_lines[empty_line_index].tag = incoming_tag;
+		//set the time stamp of the line to be that of the current maximum time stamp + 1 
+		selected_set.cache_lines[empty_line_index].time_stamp = time_stamp_container[1] + 1;
+		//set the valid bit on the line to 1 to indicate that there is data in the line
+		selected_set.cache_lines[empty_line_index].valid_bit = 1;
+		//the line is usable once its miss completes
+		selected_set.cache_lines[empty_line_index].ready_time = fill_ready_time;
+		//reflect change in the selected set back into the cache object
+		main_cache.sets[set_index] = selected_set;
+
+	}
+	//now we are done with the time_stamp_container object so we can free it
+	free(time_stamp_container);
+	//we have modified all of the members of the cache_statistics struct, return it to main
+	return cache_statistics;
+}
+
+
+
+
+/* Specialized simulation kernels. When nothing but the hit, miss and eviction counts is being collected, run_simulation
+*  does far more work per access than needed: it recomputes the shifts, walks a runtime number of lines, and tracks
+*  prefetch, victim cache and MSHR state. The kernels below do the same LRU bookkeeping for one fixed associativity,
+*  so the compiler can unroll the lookup, and keep the time stamps exactly as run_simulation would, so a cache can move
+*  between the two (a checkpoint saved by one and resumed by the other, for example).
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache main_cache --> the complete cache object
+*
+*	cache_stats cache_statistics --> the running counts and the geometry
+*
+*	memory_address address --> the address being accessed
+*
+*	=======
+*	Returns
+*	=======
+*
+*	cache_stats object updated with this access
+*/
+typedef cache_stats (*simulation_kernel)(cache main_cache, cache_stats cache_statistics, memory_address address);
+
+
+//direct mapped: a single load, compare and store of the line's tag
+cache_stats direct_mapped_kernel(cache main_cache, cache_stats cache_statistics, memory_address address){
+	memory_address block = address >> cache_statistics.b;
+	cache_set_line* line = &main_cache.sets[block & (((memory_address) 1 << cache_statistics.s) - 1)].cache_lines[0];
+	memory_address incoming_tag = block >> cache_statistics.s;
+	if (line->valid_bit && line->tag == incoming_tag){
+		cache_statistics.num_hits++;
+		return cache_statistics;
+	}
+	cache_statistics.num_misses++;
+	cache_statistics.num_evictions += line->valid_bit;
+	line->valid_bit = 1;
+	line->tag = incoming_tag;
+	return cache_statistics;
+}
+
+
+//E-way LRU with E known at compile time. One pass over the set finds the hit, the newest time stamp, the first empty
+//line and the LRU line, the same choices run_simulation and find_LRU_index make.
+#define DEFINE_LRU_KERNEL(WAYS) \
+cache_stats lru_kernel_##WAYS(cache main_cache, cache_stats cache_statistics, memory_address address){ \
+	memory_address block = address >> cache_statistics.b; \
+	cache_set_line* lines = main_cache.sets[block & (((memory_address) 1 << cache_statistics.s) - 1)].cache_lines; \
+	memory_address incoming_tag = block >> cache_statistics.s; \
+	int hit_index = -1; \
+	int empty_index = -1; \
+	int lru_index = 0; \
+	long long highest_valid = 0; \
+	long long highest_time_stamp = lines[0].time_stamp; \
+	for (int i = 0; i < WAYS; i++){ \
+		if (lines[i].valid_bit){ \
+			if (lines[i].tag == incoming_tag){ \
+				hit_index = i; \
+			} \
+			if (lines[i].time_stamp > highest_valid){ \
+				highest_valid = lines[i].time_stamp; \
+			} \
+		} \
+		else if (empty_index < 0){ \
+			empty_index = i; \
+		} \
+		if (lines[i].time_stamp < lines[lru_index].time_stamp){ \
+			lru_index = i; \
+		} \
+		if (lines[i].time_stamp > highest_time_stamp){ \
+			highest_time_stamp = lines[i].time_stamp; \
+		} \
+	} \
+	if (hit_index >= 0){ \
+		cache_statistics.num_hits++; \
+		lines[hit_index].time_stamp = highest_valid + 1; \
+		return cache_statistics; \
+	} \
+	cache_statistics.num_misses++; \
+	int fill_index = empty_index; \
+	if (fill_index < 0){ \
+		cache_statistics.num_evictions++; \
+		fill_index = lru_index; \
+	} \
+	lines[fill_index].valid_bit = 1; \
+	lines[fill_index].tag = incoming_tag; \
+	lines[fill_index].time_stamp = highest_time_stamp + 1; \
+	return cache_statistics; \
+}
+
+DEFINE_LRU_KERNEL(2)
+DEFINE_LRU_KERNEL(4)
+DEFINE_LRU_KERNEL(8)
+DEFINE_LRU_KERNEL(16)
+
+
+//the associativities that have a kernel; every other one runs through run_simulation
+static const struct {
+	int ways;
+	simulation_kernel kernel;
+} kernel_table[] = {
+	{1, direct_mapped_kernel},
+	{2, lru_kernel_2},
+	{4, lru_kernel_4},
+	{8, lru_kernel_8},
+	{16, lru_kernel_16},
+};
+
+
+/* Function to pick the kernel for a cache geometry.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache_stats cache_statistics --> cache_stats object holding s, E and b
+*
+*	=======
+*	Returns
+*	=======
+*
+*	simulation_kernel, the specialized kernel for E and the index scheme, or run_simulation when there is none
+*/
+simulation_kernel select_kernel(cache_stats cache_statistics){
+	if (cache_statistics.index_scheme == INDEX_SKEWED){
+		return skewed_simulation;
+	}
+	//the kernels use the plain bit slice and shift the tag out with one shift, which needs s + b below 64
+	if (cache_statistics.index_scheme == INDEX_MODULO && cache_statistics.s + cache_statistics.b < 64){
+		for (size_t i = 0; i < sizeof(kernel_table) / sizeof(kernel_table[0]); i++){
+			if (kernel_table[i].ways == cache_statistics.E){
+				return kernel_table[i].kernel;
+			}
+		}
+	}
+	return run_simulation;
+}
+
+
+//kernel for an access to the block of the previous one: that block is in the most recently used line of its set, so
+//the access hits and leaves the LRU order as it is
+cache_stats repeat_hit(cache main_cache, cache_stats cache_statistics, memory_address address){
+	cache_statistics.num_hits++;
+	return cache_statistics;
+}
+
+
+/* Struct that remembers the block of the previous access for run-length compression.
+*
+*	=======
+*	Members
+*	=======
+*
+*	bool valid 			   block holds the block of the previous access
+*
+*	memory_address block   block the current run is on
+*/
+typedef struct {
+	bool valid;
+	memory_address block;
+}run_state;
+
+
+/* Function that does the run-length compression for both csim's trace loop and the libcsim batch path. The block of
+*  the previous access is in the most recently used line of its set, so another access to it is a hit that leaves the
+*  LRU order as it is, and only the hit needs counting.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	run_state* run --> the current run, moved on to block
+*
+*	memory_address block --> the block being accessed
+*
+*	simulation_kernel kernel --> the kernel for an access that starts a new run
+*
+*	=======
+*	Returns
+*	=======
+*
+*	simulation_kernel, repeat_hit when the access continues the run, otherwise kernel
+*/
+static inline simulation_kernel run_length_kernel(run_state* run, memory_address block, simulation_kernel kernel){
+	simulation_kernel chosen = run->valid && block == run->block ? repeat_hit : kernel;
+	run->valid = true;
+	run->block = block;
+	return chosen;
+}
+
+
+/* Function to fill a block into the cache on behalf of a prefetcher. Works like the miss path of run_simulation, but
+*  does not count a hit or a miss: a block that is already cached is left alone, otherwise the block goes into an empty
+*  line or replaces the LRU line and is marked as prefetched. A demand line thrown out this way is remembered in the
+*  prefetch victim table so a later miss on it can be blamed on the prefetch.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache main_cache --> the complete cache object
+*
+*	cache_stats cache_statistics --> cache_stats object holding the geometry and the prefetch counters
+*
+*	memory_address address --> any address inside the block to prefetch
+*
+*	=======
+*	Returns
+*	=======
+*
+*	cache_stats object with the prefetch counters updated
+*/
+cache_stats prefetch_block(cache main_cache, cache_stats cache_statistics, memory_address address){
+	memory_address set_index = find_set_index(cache_statistics, address);
+	memory_address incoming_tag = find_tag(cache_statistics, address);
+	cache_set selected_set = main_cache.sets[set_index];
+
+	//nothing to do when the block is already cached
+	for (int i=0; i < cache_statistics.E; i++){
+		if(selected_set.cache_lines[i].valid_bit && selected_set.cache_lines[i].tag == incoming_tag){
+			return cache_statistics;
+		}
+	}
+
+	long long time_stamp_container[2];
+	int LRU_index = find_LRU_index(selected_set, cache_statistics, time_stamp_container);
+	int fill_index = find_empty_line(selected_set, cache_statistics);
+	//a partitioned cache fills only the ways of the access's class
+	if (cache_statistics.way_mask != 0){
+		int evict;
+		LRU_index = find_partition_line(selected_set, cache_statistics, &evict);
+		fill_index = evict ? -1 : LRU_index;
+	}
+	if (fill_index < 0){
+		//evict the LRU line
+		fill_index = LRU_index;
+		cache_set_line* victim = &selected_set.cache_lines[fill_index];
+		if (victim->prefetched){
+			cache_statistics.prefetch_unused++;
+		}
+		else {
+			//remember the demand block this prefetch threw out
+			memory_address victim_block = line_block(cache_statistics, victim->tag, set_index);
+			main_cache.prefetch_victims[victim_block % PREFETCH_VICTIMS] = victim_block + 1;
+		}
+		//the evicted line drops into the victim cache
+		if (main_cache.victim_size > 0){
+			victim_insert(main_cache, line_block(cache_statistics, victim->tag, set_index),
+						  access_clock(cache_statistics));
+		}
+	}
+
+	cache_set_line* line = &selected_set.cache_lines[fill_index];
+	line->valid_bit = 1;
+	line->tag = incoming_tag;
+	line->time_stamp = time_stamp_container[1] + 1;
+	line->prefetched = 1;
+	line->ready_time = access_clock(cache_statistics) + cache_statistics.prefetch_latency;
+	cache_statistics.prefetch_issued++;
+	return cache_statistics;
+}
+
+
+/* Function to read one record from whichever kind of trace it came from: text lines go through trace_parse_line, binary
+*  records are unpacked as they are.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const trace_reader* reader --> the trace the record was read from
+*
+*	const char* line --> the line (or binary record) returned by the reader
+*
+*	char* interaction_type, memory_address* address, int* size, int* class_id --> filled as by trace_parse_line
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, true if a complete record was read
+*/
+static inline bool read_record(const trace_reader* reader, const char* line, char* interaction_type,
+							   memory_address* address, int* size, int* class_id){
+	if (reader->binary){
+		return trace_decode_record(line, interaction_type, address, size, class_id);
+	}
+	return trace_parse_line(line, interaction_type, address, size, class_id);
+}
+
+
+/* Function to set up the sampling state. Set sampling picks the sets whose hashed index is a multiple of the sample
+*  rate, so power-of-two strided workloads do not all land in (or all miss) the sampled sets.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	sampling_state* sampler --> the sampling state to initialize, with set_sample_rate, period, warmup and window
+*								already filled in from the command line
+*
+*	long long num_sets --> number of sets in the cache
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+void init_sampling(sampling_state* sampler, long long num_sets){
+	sampler->set_sampled = NULL;
+	sampler->set_accesses = NULL;
+	sampler->set_misses = NULL;
+	if (sampler->set_sample_rate > 1){
+		sampler->set_sampled = (bool*) malloc(sizeof(bool) * num_sets);
+		sampler->set_accesses = (long long*) calloc(num_sets, sizeof(long long));
+		sampler->set_misses = (long long*) calloc(num_sets, sizeof(long long));
+		long long selected = 0;
+		for (long long i = 0; i < num_sets; i++){
+			//mix the index bits (splitmix64 finalizer) so neighbouring sets are selected independently
+			unsigned long long hash = (unsigned long long) i + 0x9E3779B97F4A7C15ULL;
+			hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+			hash ^= hash >> 31;
+			sampler->set_sampled[i] = (hash % sampler->set_sample_rate) == 0;
+			selected += sampler->set_sampled[i];
+		}
+		//always simulate at least one set
+		if (selected == 0){
+			sampler->set_sampled[0] = true;
+		}
+	}
+}
+
+
+/* Function to compute the 95% confidence half-width of a ratio estimator m/a over n clusters (sets or windows).
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	double n --> number of sampled clusters
+*
+*	double sum_a, sum_m, sum_aa, sum_mm, sum_am --> sums of the cluster accesses, misses and their products
+*
+*	double sampled_fraction --> fraction of the population that was sampled, for the finite population correction
+*
+*	=======
+*	Returns
+*	=======
+*
+*	double, the half-width of the confidence interval on the miss ratio
+*/
+double ratio_confidence(double n, double sum_a, double sum_m, double sum_aa, double sum_mm, double sum_am, double sampled_fraction){
+	if (n < 2 || sum_a == 0){
+		return 0.0;
+	}
+	double ratio = sum_m / sum_a;
+	double mean_a = sum_a / n;
+	//sum of the squared residuals (m_i - ratio * a_i)^2
+	double residuals = sum_mm - 2 * ratio * sum_am + ratio * ratio * sum_aa;
+	if (residuals < 0){
+		residuals = 0;
+	}
+	double variance = (1 - sampled_fraction) * residuals / ((n - 1) * n * mean_a * mean_a);
+	return 1.96 * sqrt(variance);
+}
+
+
+/* Function to close a time sampling window and add it to the running sums.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	sampling_state* sampler --> the sampling state whose window just ended
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+void close_sample_window(sampling_state* sampler){
+	double a = sampler->window_accesses;
+	double m = sampler->window_misses;
+	if (a > 0){
+		sampler->windows++;
+		sampler->sum_a += a;
+		sampler->sum_m += m;
+		sampler->sum_aa += a * a;
+		sampler->sum_mm += m * m;
+		sampler->sum_am += a * m;
+	}
+	sampler->window_accesses = 0;
+	sampler->window_misses = 0;
+}
+
+
+/* Function to print the sampled estimate and its confidence interval, and to scale the simulated counts up to the
+*  whole trace so printSummary reports extrapolated totals.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	sampling_state* sampler --> the sampling state after the whole trace was read
+*
+*	cache_stats cache_statistics --> the counts of the simulated accesses
+*
+*	long long num_sets --> number of sets in the cache
+*
+*	=======
+*	Returns
+*	=======
+*
+*	cache_stats object with the extrapolated hits, misses and evictions
+*/
+cache_stats finish_sampling(sampling_state* sampler, cache_stats cache_statistics, long long num_sets){
+	double n = 0, sum_a = 0, sum_m = 0, sum_aa = 0, sum_mm = 0, sum_am = 0;
+	double sampled_fraction = 0;
+	double total = sampler->total_accesses;
+
+	if (sampler->set_sample_rate > 1){
+		//every sampled set is one cluster
+		for (long long i = 0; i < num_sets; i++){
+			if (!sampler->set_sampled[i]){
+				continue;
+			}
+			double a = sampler->set_accesses[i];
+			double m = sampler->set_misses[i];
+			n++;
+			sum_a += a;
+			sum_m += m;
+			sum_aa += a * a;
+			sum_mm += m * m;
+			sum_am += a * m;
+		}
+		sampled_fraction = n / num_sets;
+		printf("Set sampling: %.0f of %lli sets, %lli of %lli accesses simulated\n",
+			n, num_sets, sampler->sampled_accesses, sampler->total_accesses);
+	}
+	else {
+		//every measured window is one cluster
+		close_sample_window(sampler);
+		n = sampler->windows;
+		sum_a = sampler->sum_a;
+		sum_m = sampler->sum_m;
+		sum_aa = sampler->sum_aa;
+		sum_mm = sampler->sum_mm;
+		sum_am = sampler->sum_am;
+		sampled_fraction = (double) sampler->window / sampler->period;
+		//skipped records were never parsed, assume they carry as many accesses per record (or per byte, when they were
+		//not even counted) as the parsed ones
+		if (sampler->skipped_bytes > 0 && sampler->parsed_bytes > 0){
+			total = (double) sampler->total_accesses * (sampler->parsed_bytes + sampler->skipped_bytes) / sampler->parsed_bytes;
+		}
+		else if (sampler->parsed_records > 0){
+			total = (double) sampler->total_accesses * sampler->records / sampler->parsed_records;
+		}
+		printf("Time sampling: %.0f windows of %lli records every %lli (warm-up %lli), %lli of ~%.0f accesses measured\n",
+			n, sampler->window, sampler->period, sampler->warmup, sampler->sampled_accesses, total);
+	}
+
+	//the interval only covers the spread between the sampled sets; if the sampled sets see a very different share
+	//of the traffic than their share of the cache, a few hot sets dominate the trace and the estimate is biased by
+	//an amount the interval knows nothing about, so no interval is given at all
+	bool biased = false;
+	if (sampler->set_sample_rate > 1 && sampler->total_accesses > 0){
+		double access_share = (double) sampler->sampled_accesses / sampler->total_accesses;
+		if (access_share < sampled_fraction / 2 || access_share > sampled_fraction * 2){
+			printf("Warning: sampled sets received %.2f%% of the accesses but are %.2f%% of the sets, estimate may be biased\n",
+				access_share * 100, sampled_fraction * 100);
+			biased = true;
+		}
+	}
+
+	double ratio = sum_a > 0 ? sum_m / sum_a : 0.0;
+	if (biased){
+		printf("Estimated miss ratio: %.6f (no confidence interval, the sample is biased; use a lower --set-sample)\n", ratio);
+	}
+	else {
+		double half_width = ratio_confidence(n, sum_a, sum_m, sum_aa, sum_mm, sum_am, sampled_fraction);
+		printf("Estimated miss ratio: %.6f +/- %.6f (95%% CI)\n", ratio, half_width);
+	}
+
+	//scale the counted accesses up to the whole trace
+	double scale = sampler->sampled_accesses > 0 ? total / sampler->sampled_accesses : 0.0;
+	cache_statistics.num_hits = (long long) (cache_statistics.num_hits * scale + 0.5);
+	cache_statistics.num_misses = (long long) (cache_statistics.num_misses * scale + 0.5);
+	cache_statistics.num_evictions = (long long) (cache_statistics.num_evictions * scale + 0.5);
+
+	free(sampler->set_sampled);
+	free(sampler->set_accesses);
+	free(sampler->set_misses);
+	return cache_statistics;
+}
+
+
+/* Struct that holds the optional models an access passes through on its way to the cache.
+*
+*	========
+*	Members
+*	========
+*
+*	sampling_state* sampler    the sampling state, always set (sampling may be off)
+*
+*	bool sampling 		   set or time sampling is on
+*
+*	bool measuring 		   false during a time sampling warm-up, where the cache is updated but nothing is counted
+*
+*	reuse_profile* profile 	   the profiler, NULL when profiling is off
+*
+*	prefetcher* pf 		   the prefetchers, NULL when prefetching is off
+*
+*	tlb* translation 	   the TLB and page walker, NULL when translation is not modeled
+*
+*	cache* l2_cache 	   second level cache that L1 misses go to, NULL when there is none
+*
+*	cache_stats* l2_statistics	geometry and counts of the second level cache
+*
+*	timing_model* timing   the latency model, NULL when cycles are not estimated
+*
+*	int op 				   OP_LOAD, OP_STORE or OP_MODIFY, the operation of the current record
+*
+*	bool run_length 	   collapse runs of accesses to one block, only safe when no model above looks at each access
+*
+*	run_state run 		   the block of the previous access, for run_length
+*
+*	simulation_kernel kernel	the specialized kernel used when run_length is set
+*/
+typedef struct {
+	sampling_state* sampler;
+	bool sampling;
+	bool measuring;
+	reuse_profile* profile;
+	prefetcher* pf;
+	tlb* translation;
+	cache* l2_cache;
+	cache_stats* l2_statistics;
+	timing_model* timing;
+	int op;
+	bool run_length;
+	run_state run;
+	simulation_kernel kernel;
+}simulation_hooks;
+
+
+/* Function to run one access through the cache, honoring the sampling modes.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache the_cache --> the complete cache object
+*
+*	cache_stats cache_statistics --> the running counts
+*
+*	memory_address address --> the address being accessed
+*
+*	sampling_state* sampler --> the sampling state
+*
+*	bool measuring --> false during a time sampling warm-up, where the cache is updated but nothing is counted
+*
+*	simulation_kernel kernel --> simulates the access: run_simulation, or a specialized kernel when no model looks at
+*								 the access
+*
+*	=======
+*	Returns
+*	=======
+*
+*	cache_stats object updated with this access
+*/
+cache_stats demand_access(cache the_cache, cache_stats cache_statistics, memory_address address,
+						  sampling_state* sampler, bool measuring, simulation_kernel kernel){
+	sampler->total_accesses++;
+
+	//set sampling: accesses to sets that are not sampled are not simulated at all
+	if (sampler->set_sample_rate > 1){
+		memory_address set_index = find_set_index(cache_statistics, address);
+		if (!sampler->set_sampled[set_index]){
+			return cache_statistics;
+		}
+		long long previous_misses = cache_statistics.num_misses;
+		cache_statistics = kernel(the_cache, cache_statistics, address);
+		sampler->set_accesses[set_index]++;
+		sampler->set_misses[set_index] += cache_statistics.num_misses - previous_misses;
+		sampler->sampled_accesses++;
+		return cache_statistics;
+	}
+
+	//warm-up accesses change the cache state but are thrown out of the counts, only the clock keeps them
+	if (!measuring){
+		kernel(the_cache, cache_statistics, address);
+		cache_statistics.clock_base++;
+		return cache_statistics;
+	}
+
+	long long previous_misses = cache_statistics.num_misses;
+	cache_statistics = kernel(the_cache, cache_statistics, address);
+	sampler->window_accesses++;
+	sampler->window_misses += cache_statistics.num_misses - previous_misses;
+	sampler->sampled_accesses++;
+	return cache_statistics;
+}
+
+
+/* Function to run one access through the cache and, on a miss, find out where it is served from: the victim cache,
+*  the second level cache or memory. The level is charged to the timing model.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache the_cache --> the complete cache object
+*
+*	cache_stats cache_statistics --> the running counts
+*
+*	memory_address address --> the address being accessed
+*
+*	simulation_hooks* hooks --> the optional models configured on the command line
+*
+*	bool translation --> true for a page table read done by a page walk
+*
+*	=======
+*	Returns
+*	=======
+*
+*	cache_stats object updated with this access
+*/
+cache_stats hierarchy_access(cache the_cache, cache_stats cache_statistics, memory_address address,
+							 simulation_hooks* hooks, bool translation){
+	long long previous_sampled = hooks->sampler->sampled_accesses;
+	long long previous_misses = cache_statistics.num_misses;
+	long long previous_victim_hits = cache_statistics.victim_hits;
+	cache_statistics = demand_access(the_cache, cache_statistics, address, hooks->sampler, hooks->measuring, run_simulation);
+
+	//accesses skipped by sampling or only warming the cache are not charged
+	if (hooks->sampler->sampled_accesses == previous_sampled){
+		return cache_statistics;
+	}
+
+	int served = SERVED_L1;
+	if (cache_statistics.num_misses != previous_misses){
+		if (cache_statistics.victim_hits != previous_victim_hits){
+			served = SERVED_VICTIM;
+		}
+		else if (hooks->l2_cache != NULL){
+			//an L1 miss looks the block up in the second level
+			long long previous_l2_misses = hooks->l2_statistics->num_misses;
+			*hooks->l2_statistics = run_simulation(*hooks->l2_cache, *hooks->l2_statistics, address);
+			served = hooks->l2_statistics->num_misses != previous_l2_misses ? SERVED_MEMORY : SERVED_L2;
+		}
+		else {
+			served = SERVED_MEMORY;
+		}
+	}
+	if (hooks->timing != NULL){
+		timing_access(hooks->timing, hooks->op, served, translation);
+	}
+	return cache_statistics;
+}
+
+
+/* Function to push one access from the trace through the profiler, the TLB, the cache and the prefetchers.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	cache the_cache --> the complete cache object
+*
+*	cache_stats cache_statistics --> the running counts
+*
+*	memory_address address --> the address being accessed
+*
+*	simulation_hooks* hooks --> the optional models configured on the command line
+*
+*	=======
+*	Returns
+*	=======
+*
+*	cache_stats object updated with this access
+*/
+cache_stats process_access(cache the_cache, cache_stats cache_statistics, memory_address address, simulation_hooks* hooks){
+	sampling_state* sampler = hooks->sampler;
+
+	//run-length compression
+	if (hooks->run_length){
+		//main drops the accesses to sets that set sampling does not simulate before they get here, so they never start
+		//or extend a run. Nothing else looks at this access, so the specialized kernel can do it alone.
+		simulation_kernel kernel = run_length_kernel(&hooks->run, find_block(cache_statistics, address), hooks->kernel);
+		if (hooks->sampling){
+			return demand_access(the_cache, cache_statistics, address, sampler, hooks->measuring, kernel);
+		}
+		return kernel(the_cache, cache_statistics, address);
+	}
+
+	if (hooks->profile != NULL){
+		profile_access(hooks->profile, find_block(cache_statistics, address));
+	}
+
+	//translate first: a TLB miss reads the page table through the cache before the data can be accessed
+	if (hooks->translation != NULL){
+		unsigned long long pte_addresses[PAGE_WALK_MAX_LEVELS];
+		int walk_length = tlb_translate(hooks->translation, address, pte_addresses);
+		for (int i = 0; i < walk_length; i++){
+			long long previous_hits = cache_statistics.num_hits;
+			long long previous_misses = cache_statistics.num_misses;
+			cache_statistics = hierarchy_access(the_cache, cache_statistics, pte_addresses[i], hooks, true);
+			hooks->translation->walk_accesses++;
+			hooks->translation->walk_hits += cache_statistics.num_hits - previous_hits;
+			hooks->translation->walk_misses += cache_statistics.num_misses - previous_misses;
+		}
+		//a translation found in the L2 TLB costs its lookup latency
+		if (walk_length == 0 && hooks->translation->last_hit_level == 1 && hooks->timing != NULL && hooks->measuring){
+			timing_tlb2_hit(hooks->timing, hooks->op);
+		}
+	}
+
+	long long previous_misses = cache_statistics.num_misses;
+	long long previous_useful = cache_statistics.prefetch_useful;
+	cache_statistics = hierarchy_access(the_cache, cache_statistics, address, hooks, false);
+
+	//the prefetchers watch every demand access and fill their picks after it
+	if (hooks->pf != NULL){
+		//an access set sampling skipped is invisible to the prefetchers too
+		if (sampler->set_sample_rate > 1 && !sampler->set_sampled[find_set_index(cache_statistics, address)]){
+			return cache_statistics;
+		}
+		unsigned long long candidates[PREFETCH_MAX_CANDIDATES];
+		int count = prefetcher_observe(hooks->pf, address >> cache_statistics.b,
+									   cache_statistics.num_misses != previous_misses,
+									   cache_statistics.prefetch_useful != previous_useful, candidates);
+		for (int i = 0; i < count; i++){
+			memory_address prefetch_address = (memory_address) candidates[i] << cache_statistics.b;
+			if (sampler->set_sample_rate > 1 && !sampler->set_sampled[find_set_index(cache_statistics, prefetch_address)]){
+				continue;
+			}
+			long long previous_issued = cache_statistics.prefetch_issued;
+			cache_statistics = prefetch_block(the_cache, cache_statistics, prefetch_address);
+			//a prefetch fill takes its turn on the memory channel
+			if (hooks->timing != NULL && cache_statistics.prefetch_issued != previous_issued){
+				timing_prefetch(hooks->timing);
+			}
+		}
+	}
+	return cache_statistics;
+}
+
+
+/* Struct that defines the fixed header of a checkpoint file. The header is followed by one record per line in set
+*  order (valid bit, tag, time stamp) and, when set sampling is on, the per set sampling counters. Values are stored in
+*  the native byte order, so a checkpoint is only meant to be resumed on the same kind of machine.
+*
+*	========
+*	Members
+*	========
+*
+*	char magic[8] 		   always CHECKPOINT_MAGIC, used to reject files that are not checkpoints
+*
+*	int s, E, b 		   geometry of the checkpointed cache, has to match the command line on resume
+*
+*	long long num_hits, num_misses, num_evictions	counts at the time of the checkpoint
+*
+*	long long clock_base 	   accesses simulated but not counted, so the resumed access clock goes on where it was
+*
+*	long long trace_offset 	   byte offset in the trace file of the first record that was not simulated yet
+*
+*	long long trace_size 	   size of the trace file, has to match on resume
+*
+*	unsigned long long trace_fingerprint	trace_fingerprint of the trace at trace_offset, has to match on resume
+*
+*	long long records_read 	   number of trace records read before the checkpoint
+*
+*	sampling_state sampler 	   scalar part of the sampling state (the per set arrays follow the lines)
+*/
+typedef struct {
+	char magic[8];
+	int s;
+	int E;
+	int b;
+	long long num_hits;
+	long long num_misses;
+	long long num_evictions;
+	long long clock_base;
+	long long trace_offset;
+	long long trace_size;
+	unsigned long long trace_fingerprint;
+	long long records_read;
+	sampling_state sampler;
+}checkpoint_header;
+
+//first bytes of every checkpoint file
+#define CHECKPOINT_MAGIC "CSIMCKP4"
+
+
+/* Struct that holds one line in a checkpoint file. The block contents are never looked at by the simulator, so only
+*  the bookkeeping members are saved.
+*/
+typedef struct {
+	int valid_bit;
+	long long time_stamp;
+	memory_address tag;
+}checkpoint_line;
+
+
+/* Function to write the complete simulator state to a checkpoint file. The state is written to "<path>.tmp" first
+*  and renamed over the old checkpoint, so a run that dies while checkpointing still leaves the previous checkpoint intact.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const char* path --> name of the checkpoint file
+*
+*	cache the_cache --> the cache whose lines are saved
+*
+*	cache_stats cache_statistics --> geometry and counts to save
+*
+*	long long num_sets --> number of sets in the cache
+*
+*	sampling_state* sampler --> sampling state to save
+*
+*	const trace_reader* trace --> the trace being read, to identify it
+*
+*	long long trace_offset --> byte offset of the next record in the trace file
+*
+*	long long records_read --> number of records read so far
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, true if the checkpoint was written
+*/
+bool save_checkpoint(const char* path, cache the_cache, cache_stats cache_statistics, long long num_sets,
+					 sampling_state* sampler, const trace_reader* trace, long long trace_offset, long long records_read){
+	char temp_path[4096];
+	snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+	FILE* checkpoint_fp = fopen(temp_path, "wb");
+	if (checkpoint_fp == NULL){
+		return false;
+	}
+
+	checkpoint_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.s = cache_statistics.s;
+	header.E = cache_statistics.E;
+	header.b = cache_statistics.b;
+	header.num_hits = cache_statistics.num_hits;
+	header.num_misses = cache_statistics.num_misses;
+	header.num_evictions = cache_statistics.num_evictions;
+	header.clock_base = cache_statistics.clock_base;
+	header.trace_offset = trace_offset;
+	header.trace_size = (long long) trace->size;
+	header.trace_fingerprint = trace_fingerprint(trace, trace_offset);
+	header.records_read = records_read;
+	header.sampler = *sampler;
+	bool ok = fwrite(&header, sizeof(header), 1, checkpoint_fp) == 1;
+
+	//one compact record per line, set by set
+	checkpoint_line* lines = (checkpoint_line*) malloc(sizeof(checkpoint_line) * cache_statistics.E);
+	for (long long i = 0; ok && i < num_sets; i++){
+		for (int j = 0; j < cache_statistics.E; j++){
+			cache_set_line current_line = the_cache.sets[i].cache_lines[j];
+			lines[j].valid_bit = current_line.valid_bit;
+			lines[j].time_stamp = current_line.time_stamp;
+			lines[j].tag = current_line.tag;
+		}
+		ok = fwrite(lines, sizeof(checkpoint_line), cache_statistics.E, checkpoint_fp) == (size_t) cache_statistics.E;
+	}
+	free(lines);
+
+	//set sampling keeps per set counters
+	if (ok && sampler->set_sample_rate > 1){
+		ok = fwrite(sampler->set_sampled, sizeof(bool), num_sets, checkpoint_fp) == (size_t) num_sets &&
+			 fwrite(sampler->set_accesses, sizeof(long long), num_sets, checkpoint_fp) == (size_t) num_sets &&
+			 fwrite(sampler->set_misses, sizeof(long long), num_sets, checkpoint_fp) == (size_t) num_sets;
+	}
+
+	if (fclose(checkpoint_fp) != 0){
+		ok = false;
+	}
+	if (!ok){
+		remove(temp_path);
+		return false;
+	}
+	return rename(temp_path, path) == 0;
+}
+
+
+/* Function to restore the simulator state from a checkpoint file. With counters_too set the counts, sampling state and
+*  trace position are restored as well (resuming a run), and the trace has to be the one the checkpoint was taken on:
+*  same size, the same bytes at its start and before the saved position, and as many records before that position as
+*  had been read. Without it only the cache contents are
+*  loaded (starting a new trace on a cache that was warmed up by an earlier run), whatever the trace.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const char* path --> name of the checkpoint file
+*
+*	cache the_cache --> freshly initialized cache with the same geometry, filled from the file
+*
+*	cache_stats* cache_statistics --> geometry to check against, counts are restored into it
+*
+*	long long num_sets --> number of sets in the cache
+*
+*	sampling_state* sampler --> initialized sampling state, restored when counters_too is set
+*
+*	bool counters_too --> true to restore the counts and the trace position as well as the cache contents
+*
+*	const trace_reader* trace --> the trace the run continues on, NULL if it could not be opened
+*
+*	long long* trace_offset --> filled with the byte offset of the next record to read
+*
+*	long long* records_read --> filled with the number of records read before the checkpoint
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, true if the checkpoint was valid and loaded
+*/
+bool load_checkpoint(const char* path, cache the_cache, cache_stats* cache_statistics, long long num_sets,
+					 sampling_state* sampler, bool counters_too, const trace_reader* trace, long long* trace_offset,
+					 long long* records_read){
+	FILE* checkpoint_fp = fopen(path, "rb");
+	if (checkpoint_fp == NULL){
+		printf("Unable to open checkpoint %s\n", path);
+		return false;
+	}
+
+	checkpoint_header header;
+	if (fread(&header, sizeof(header), 1, checkpoint_fp) != 1 ||
+		memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0){
+		printf("%s is not a checkpoint file\n", path);
+		fclose(checkpoint_fp);
+		return false;
+	}
+	//the lines only make sense in a cache of the same shape
+	if (header.s != cache_statistics->s || header.E != cache_statistics->E || header.b != cache_statistics->b){
+		printf("Checkpoint %s was taken with -s %d -E %d -b %d\n", path, header.s, header.E, header.b);
+		fclose(checkpoint_fp);
+		return false;
+	}
+	//per set counters of a resumed sampled run only line up with the same sampling parameters
+	if (counters_too && (header.sampler.set_sample_rate != sampler->set_sample_rate ||
+						 header.sampler.period != sampler->period ||
+						 header.sampler.warmup != sampler->warmup ||
+						 header.sampler.window != sampler->window)){
+		printf("Checkpoint %s was taken with different sampling parameters\n", path);
+		fclose(checkpoint_fp);
+		return false;
+	}
+	//a saved position means nothing in another trace, or in the same file rewritten
+	if (counters_too && (trace == NULL || header.trace_size != (long long) trace->size ||
+						 header.trace_offset < 0 || header.trace_offset > header.trace_size ||
+						 header.trace_fingerprint != trace_fingerprint(trace, header.trace_offset) ||
+						 header.records_read != trace_records_before(trace, header.trace_offset))){
+		printf("Checkpoint %s was taken on a different trace, or the trace has changed since\n", path);
+		fclose(checkpoint_fp);
+		return false;
+	}
+
+	bool ok = true;
+	checkpoint_line* lines = (checkpoint_line*) malloc(sizeof(checkpoint_line) * cache_statistics->E);
+	for (long long i = 0; ok && i < num_sets; i++){
+		ok = fread(lines, sizeof(checkpoint_line), cache_statistics->E, checkpoint_fp) == (size_t) cache_statistics->E;
+		for (int j = 0; ok && j < cache_statistics->E; j++){
+			the_cache.sets[i].cache_lines[j].valid_bit = lines[j].valid_bit;
+			the_cache.sets[i].cache_lines[j].time_stamp = lines[j].time_stamp;
+			the_cache.sets[i].cache_lines[j].tag = lines[j].tag;
+		}
+	}
+	free(lines);
+
+	if (ok && counters_too){
+		//keep our own per set arrays, the file holds their contents
+		bool* set_sampled = sampler->set_sampled;
+		long long* set_accesses = sampler->set_accesses;
+		long long* set_misses = sampler->set_misses;
+		*sampler = header.sampler;
+		sampler->set_sampled = set_sampled;
+		sampler->set_accesses = set_accesses;
+		sampler->set_misses = set_misses;
+		if (sampler->set_sample_rate > 1){
+			ok = fread(sampler->set_sampled, sizeof(bool), num_sets, checkpoint_fp) == (size_t) num_sets &&
+				 fread(sampler->set_accesses, sizeof(long long), num_sets, checkpoint_fp) == (size_t) num_sets &&
+				 fread(sampler->set_misses, sizeof(long long), num_sets, checkpoint_fp) == (size_t) num_sets;
+		}
+		cache_statistics->num_hits = header.num_hits;
+		cache_statistics->num_misses = header.num_misses;
+		cache_statistics->num_evictions = header.num_evictions;
+		cache_statistics->clock_base = header.clock_base;
+		*trace_offset = header.trace_offset;
+		*records_read = header.records_read;
+	}
+	fclose(checkpoint_fp);
+
+	if (!ok){
+		printf("Checkpoint %s is truncated\n", path);
+	}
+	return ok;
+}
 
-	//Now that we have the index of the least recently used element, we need to deal with the cases
-	//of either:
-	//
-	//The cache was full and we need to evict
-	//
-	//The cache was not full and we can store the line in cache
 
-	//Case 1: cache was full and we need to evict
-	if (line_is_full){
-		//we need to evict someone from the cache
+/* Library interface (libcsim.h). A handle wraps one cache and runs every access through the same run-length check and
+*  specialized kernel csim uses when it only counts hits, misses and evictions. The counts of each batch are added to
+*  the totals csim_stats returns.
+*/
 
-		//first we increment the eviction counter
-		cache_statistics.num_evictions++;
+//how many accesses ahead csim_access_batch prefetches the set it will touch
+#define BATCH_PREFETCH_DISTANCE 8
 
-		//next we need to evict someone, so we set the tag in the cache at the LRU_index to be the tag of the
-		//incoming data
-		selected_set.cache_lines[LRU_index].tag = incoming_tag;
+struct csim_handle {
+	cache the_cache;
+	cache_stats cache_statistics;
+	long long num_sets;
+	simulation_kernel kernel;
+	run_state run;
+	csim_counts totals;
+};
 
-		//now we modify the time stamp of the element in the line to reflect its access time, which is 
-		//the highest current time stamp + 1
-		selected_set.cache_lines[LRU_index].time_stamp = time_stamp_container[1] + 1;
-		//store the selected set in the cache at the set_index position
-		main_cache.sets[set_index] = selected_set;
+
+csim_handle* csim_create(const csim_config* config){
+	//a set count that is given directly is indexed like csim -S: s is the bits needed to count the sets
+	int s = config->s;
+	if (config->sets > 0){
+		for (s = 0; (1L << s) < config->sets && s < 31; s++){
+		}
 	}
-	//else there was room in the cache and we just need to find a line in the selected set to put it in
-	else {
+	if (s < 0 || config->b < 0 || config->E <= 0 || s + config->b >= 64 || s > 30 || config->sets < 0){
+		return NULL;
+	}
+	csim_handle* handle = (csim_handle*) calloc(1, sizeof(csim_handle));
+	if (handle == NULL){
+		return NULL;
+	}
+	handle->cache_statistics.s = s;
+	handle->cache_statistics.E = config->E;
+	handle->cache_statistics.b = config->b;
+	handle->cache_statistics.S = 1 << s;
+	handle->cache_statistics.B = 1 << (config->b < 30 ? config->b : 30);
+	handle->num_sets = 1LL << s;
+	if (config->sets > 0 && config->sets != 1L << s){
+		handle->cache_statistics.index_scheme = INDEX_DIVIDE;
+		handle->cache_statistics.S = (int) config->sets;
+		handle->cache_statistics.block_divider = make_divider((memory_address) 1 << config->b);
+		handle->cache_statistics.set_divider = make_divider(config->sets);
+		handle->num_sets = config->sets;
+	}
+	//the library never reads the block contents, a one byte block per line is enough
+	handle->the_cache = initialize_cache(handle->num_sets, config->E, 1);
+	handle->kernel = select_kernel(handle->cache_statistics);
+	return handle;
+}
 
-		//get the index of an empty line in the currently selected cache set
-		int empty_line_index = find_empty_line(selected_set, cache_statistics);
 
-		//printf("there was room in the cache");
+/* Function that runs a batch for csim_access_batch and csim_access_batch_misses.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	csim_handle* handle, const addr_t* addresses, const uint8_t* ops, size_t n --> as for csim_access_batch
+*
+*	addr_t* misses --> receives the address of every access that missed, NULL when the caller does not want them
+*
+*	=======
+*	Returns
+*	=======
+*
+*	size_t, the number of addresses written to misses
+*/
+static size_t access_batch(csim_handle* handle, const addr_t* addresses, const uint8_t* ops, size_t n, addr_t* misses){
+	cache_stats cache_statistics = handle->cache_statistics;
+	int s = cache_statistics.s;
+	int b = cache_statistics.b;
+	bool modulo = cache_statistics.index_scheme == INDEX_MODULO;
+	size_t num_missed = 0;
+	for (size_t i = 0; i < n; i++){
+		//start bringing in the set of an access a few places ahead
+		if (i + BATCH_PREFETCH_DISTANCE < n){
+			memory_address ahead = modulo ? (addresses[i + BATCH_PREFETCH_DISTANCE] >> b) & (((memory_address) 1 << s) - 1)
+										  : find_set_index(cache_statistics, addresses[i + BATCH_PREFETCH_DISTANCE]);
+			__builtin_prefetch(handle->the_cache.sets[ahead].cache_lines);
+		}
+		uint8_t op = ops != NULL ? ops[i] : CSIM_OP_LOAD;
+		int accesses = op == CSIM_OP_MODIFY ? 2 : (op == CSIM_OP_LOAD || op == CSIM_OP_STORE ? 1 : 0);
+		memory_address block = find_block(cache_statistics, addresses[i]);
+		for (int k = 0; k < accesses; k++){
+			simulation_kernel kernel = run_length_kernel(&handle->run, block, handle->kernel);
+			long long previous_misses = cache_statistics.num_misses;
+			cache_statistics = kernel(handle->the_cache, cache_statistics, addresses[i]);
+			if (misses != NULL && cache_statistics.num_misses != previous_misses){
+				misses[num_missed++] = addresses[i];
+			}
+		}
+	}
+	handle->totals.hits += cache_statistics.num_hits;
+	handle->totals.misses += cache_statistics.num_misses;
+	handle->totals.evictions += cache_statistics.num_evictions;
+	//the counts start over with every batch, the clock goes on
+	cache_statistics.clock_base += cache_statistics.num_hits + cache_statistics.num_misses;
+	cache_statistics.num_hits = 0;
+	cache_statistics.num_misses = 0;
+	cache_statistics.num_evictions = 0;
+	handle->cache_statistics = cache_statistics;
+	return num_missed;
+}
 
-		//set the tag of the empty line with the tag of the incoming data
-		selected_set.cache_lines[empty_line_index].tag = incoming_tag;
-		//set the time stamp of the line to be that of the current maximum time stamp + 1 
-		selected_set.cache_lines[empty_line_index].time_stamp = time_stamp_container[1] + 1;
-		//set the valid bit on the line to 1 to indicate that there is data in the line
-		selected_set.cache_lines[empty_line_index].valid_bit = 1;
-		//reflect change in the selected set back into the cache object
-		main_cache.sets[set_index] = selected_set;
 
+void csim_access_batch(csim_handle* handle, const addr_t* addresses, const uint8_t* ops, size_t n){
+	access_batch(handle, addresses, ops, n, NULL);
+}
+
+
+size_t csim_access_batch_misses(csim_handle* handle, const addr_t* addresses, const uint8_t* ops, size_t n,
+								addr_t* misses){
+	return access_batch(handle, addresses, ops, n, misses);
+}
+
+
+csim_counts csim_stats(const csim_handle* handle){
+	return handle->totals;
+}
+
+
+void csim_reset(csim_handle* handle){
+	for (long long i = 0; i < handle->num_sets; i++){
+		for (int j = 0; j < handle->cache_statistics.E; j++){
+			cache_set_line* line = &handle->the_cache.sets[i].cache_lines[j];
+			line->valid_bit = 0;
+			line->tag = 0;
+			line->time_stamp = 0;
+		}
 	}
-	//now we are done with the time_stamp_container object so we can free it
-	free(time_stamp_container);
-	//we have modified all of the members of the cache_statistics struct, return it to main
-	return cache_statistics;
+	handle->run.valid = false;
+	memset(&handle->totals, 0, sizeof(csim_counts));
+}
+
+
+void csim_destroy(csim_handle* handle){
+	if (handle != NULL){
+		free_allocated_memory(handle->the_cache, handle->num_sets, handle->cache_statistics.E, 1);
+		free(handle);
+	}
+}
+
+
+#ifndef CSIM_LIBRARY
+
+/* Function to read the --cat option, a comma separated list of hexadecimal way masks, one per class of service.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const char* spec --> the masks, e.g. "f0,0f"
+*
+*	unsigned int* masks --> receives the masks, room for MAX_CLASSES
+*
+*	int* num_classes --> receives the number of masks
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, false if a mask is empty or malformed, or there are too many
+*/
+bool parse_way_masks(const char* spec, unsigned int* masks, int* num_classes){
+	*num_classes = 0;
+	while (*spec != '\0'){
+		char* end;
+		unsigned long mask = strtoul(spec, &end, 16);
+		if (end == spec || mask == 0 || mask > 0xFFFFFFFFUL || *num_classes == MAX_CLASSES){
+			return false;
+		}
+		masks[(*num_classes)++] = (unsigned int) mask;
+		spec = end;
+		if (*spec == ','){
+			spec++;
+		}
+		else if (*spec != '\0'){
+			return false;
+		}
+	}
+	return *num_classes > 0;
+}
+
+
+/* Function to read the --index option into the cache geometry.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const char* spec --> modulo, xor, prime, skewed or slices:<n>
+*
+*	cache_stats* cache_statistics --> receives the scheme; s has to be set already
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, false if the scheme is unknown or does not fit the number of sets
+*/
+bool parse_index_scheme(const char* spec, cache_stats* cache_statistics){
+	int num_sets = 1 << cache_statistics->s;
+	if (strcmp(spec, "modulo") == 0){
+		cache_statistics->index_scheme = INDEX_MODULO;
+	}
+	else if (strcmp(spec, "xor") == 0){
+		cache_statistics->index_scheme = INDEX_XOR;
+	}
+	else if (strcmp(spec, "prime") == 0){
+		cache_statistics->index_scheme = INDEX_PRIME;
+		//largest prime not above the number of sets
+		int modulus = num_sets;
+		for (; modulus > 2; modulus--){
+			bool prime = true;
+			for (int d = 2; d * d <= modulus && prime; d++){
+				prime = modulus % d != 0;
+			}
+			if (prime){
+				break;
+			}
+		}
+		cache_statistics->index_modulus = modulus;
+	}
+	else if (strcmp(spec, "skewed") == 0){
+		cache_statistics->index_scheme = INDEX_SKEWED;
+	}
+	else if (strncmp(spec, "slices:", 7) == 0){
+		cache_statistics->index_scheme = INDEX_SLICED;
+		cache_statistics->slices = atoi(spec + 7);
+		//a power of two number of slices, each with at least one set
+		return cache_statistics->slices > 1 && is_power_of_two(cache_statistics->slices) &&
+			   cache_statistics->slices <= num_sets;
+	}
+	else {
+		return false;
+	}
+	return true;
 }
 
 
+/* Function to read the --schedule option.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const char* spec --> rr, weighted:<w>,<w>... with one weight per trace, or timestamp
+*
+*	int* schedule --> receives the schedule
+*
+*	int* weights --> receives the weights
+*
+*	int num_traces --> number of traces given with -t
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, false if the schedule is unknown or the weights do not match the traces
+*/
+bool parse_schedule(const char* spec, int* schedule, int* weights, int num_traces){
+	if (strcmp(spec, "rr") == 0){
+		*schedule = SCHEDULE_ROUND_ROBIN;
+		return true;
+	}
+	if (strcmp(spec, "timestamp") == 0){
+		*schedule = SCHEDULE_TIMESTAMP;
+		return true;
+	}
+	if (strncmp(spec, "weighted:", 9) != 0){
+		return false;
+	}
+	*schedule = SCHEDULE_WEIGHTED;
+	spec += 9;
+	for (int i = 0; i < num_traces; i++){
+		char* end;
+		long weight = strtol(spec, &end, 10);
+		if (end == spec || weight <= 0 || weight > 1000000){
+			return false;
+		}
+		weights[i] = (int) weight;
+		spec = end;
+		if (*spec == ','){
+			spec++;
+		}
+	}
+	return *spec == '\0' && spec[-1] != ',';
+}
 
 
 /* Main program */
@@ -714,7 +2835,7 @@ int main(int argc, char **argv)
     //declare cache object
     cache this_cache;
     //declare cache_stats object that will hold all relevant values for cache simulation
-    cache_stats cache_statistics;
+    cache_stats cache_statistics = {0};
     
     //declare variables for num sets and block size
 
@@ -723,8 +2844,11 @@ int main(int argc, char **argv)
     //block_size = 2^b
     long long block_size;
 
-    //declare file pointer so we can access the trace files 
-    FILE* file_pointer;
+    //the mapped trace files, read one line at a time in place and interleaved when there are several
+    trace_merger merger;
+    const char* line;
+    long long line_offset = 0;
+    int source = 0;
 
     //declare character to hold the type of cache interaction
     char interaction_type;
@@ -732,11 +2856,126 @@ int main(int argc, char **argv)
     memory_address address;
     //declare variable to hold the size of the interaction
     int size;
-    //declare character pointer to point to the trace file
-    char* trace_file;
+    //declare character pointers to point to the trace files, each -t adds one
+    char* trace_files[TRACE_MAX_SOURCES];
+    int num_traces = 0;
+    bool traces_ok = true;
+    //how the records of several traces are interleaved
+    int schedule = SCHEDULE_ROUND_ROBIN;
+    int weights[TRACE_MAX_SOURCES];
+    char* schedule_spec = NULL;
+    long long trace_hits[TRACE_MAX_SOURCES] = {0};
+    long long trace_misses[TRACE_MAX_SOURCES] = {0};
+    long long trace_evictions[TRACE_MAX_SOURCES] = {0};
+
+    //profiling mode: reuse distances and working set of the trace
+    bool profiling = false;
+    long long ws_window = DEFAULT_WS_WINDOW;
+    reuse_profile profile;
+
+    //sampling modes, both off by default
+    sampling_state sampler = {0};
+
+    //checkpointing: where to save, how often, and what to restore at startup
+    char* checkpoint_file = NULL;
+    long long checkpoint_every = DEFAULT_CHECKPOINT_EVERY;
+    char* resume_file = NULL;
+    char* warm_start_file = NULL;
+    long long trace_offset = 0;
+    long long records_read = 0;
+
+    //prefetchers, off unless --prefetch names some
+    char* prefetch_kinds = NULL;
+    int prefetch_degree = DEFAULT_PREFETCH_DEGREE;
+    int num_streams = DEFAULT_STREAMS;
+    prefetcher pf;
+
+    //victim cache and MSHRs, off by default
+    int victim_size = 0;
+    int mshr_entries = 0;
+    cache_statistics.mshr_window = DEFAULT_MSHR_WINDOW;
+
+    //TLB and page walks, off unless --tlb is given
+    char* tlb_levels = NULL;
+    char* page_size = DEFAULT_TLB_PAGE_SIZE;
+    tlb translation;
+
+    //second level cache and timing model, both off by default
+    char* l2_geometry = NULL;
+    cache l2_cache;
+    cache_stats l2_statistics = {0};
+    long long l2_num_sets = 0;
+    bool timing = false;
+    char* latencies = NULL;
+    double bandwidth = DEFAULT_BANDWIDTH;
+    timing_model timer;
+
+    //set index function, the plain bit slice unless --index names another
+    char* index_scheme = NULL;
+
+    //cache partitioning: a way mask per class of service, and the class of records that do not name one
+    unsigned int class_masks[MAX_CLASSES];
+    int num_classes = 0;
+    int default_class = 0;
+    int class_id;
+    long long class_hits[MAX_CLASSES] = {0};
+    long long class_misses[MAX_CLASSES] = {0};
+    long long class_evictions[MAX_CLASSES] = {0};
+    bool partition_ok = true;
+
+    //set count and block size given directly with -S and -B, 0 when -s and -b are used
+    long long sets_given = 0;
+    long long block_size_given = 0;
+
+    //read and parse the trace but simulate nothing, so csim-bench can tell parsing time from simulation time
+    bool parse_only = false;
+
+    //ingest filters, every record is kept unless one is given
+    trace_filter filter;
+    trace_filter_init(&filter);
+    bool filter_ok = true;
+    //every trace is filtered on its own, so its markers and record indices count its own records
+    trace_filter filters[TRACE_MAX_SOURCES];
+
+    //long forms of the options, short forms are kept for the autograder
+    static struct option long_options[] = {
+        {"profile",     no_argument,       NULL, 'P'},
+        {"ws-window",   required_argument, NULL, 'W'},
+        {"set-sample",  required_argument, NULL, 'R'},
+        {"time-sample", required_argument, NULL, 'T'},
+        {"checkpoint",  required_argument, NULL, 'C'},
+        {"checkpoint-every", required_argument, NULL, 'K'},
+        {"resume",      required_argument, NULL, 'U'},
+        {"warm-start",  required_argument, NULL, 'A'},
+        {"prefetch",    required_argument, NULL, 'F'},
+        {"prefetch-degree", required_argument, NULL, 'D'},
+        {"streams",     required_argument, NULL, 'N'},
+        {"prefetch-latency", required_argument, NULL, 'L'},
+        {"victim",      required_argument, NULL, 'V'},
+        {"mshr",        required_argument, NULL, 'M'},
+        {"mshr-window", required_argument, NULL, 'O'},
+        {"tlb",         required_argument, NULL, 'X'},
+        {"page-size",   required_argument, NULL, 'G'},
+        {"l2",          required_argument, NULL, '2'},
+        {"timing",      no_argument,       NULL, 'I'},
+        {"latency",     required_argument, NULL, 'Y'},
+        {"bandwidth",   required_argument, NULL, 'Z'},
+        {"index",       required_argument, NULL, 'j'},
+        {"cat",         required_argument, NULL, 'c'},
+        {"class",       required_argument, NULL, 'n'},
+        {"include",     required_argument, NULL, 'i'},
+        {"exclude",     required_argument, NULL, 'x'},
+        {"markers",     required_argument, NULL, 'k'},
+        {"records",     required_argument, NULL, 'r'},
+        {"ops",         required_argument, NULL, 'o'},
+        {"schedule",    required_argument, NULL, 'q'},
+        {"parse-only",  no_argument,       NULL, 'z'},
+        {"help",        no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
 
     char options;
-    while( (options=getopt(argc,argv,"s:E:b:t:v:h")) != -1){
+    while( (options=getopt_long(argc,argv,"s:E:b:t:v:hPW:S:B:",long_options,NULL)) != -1){
         switch(options){
         case 's':
             cache_statistics.s = atoi(optarg);
@@ -747,12 +2986,120 @@ int main(int argc, char **argv)
         case 'b':
             cache_statistics.b = atoi(optarg);
             break;
+        case 'S':
+            sets_given = atoll(optarg);
+            break;
+        case 'B':
+            block_size_given = atoll(optarg);
+            break;
         case 't':
-            trace_file = optarg;
+            if (num_traces == TRACE_MAX_SOURCES){
+                traces_ok = false;
+                break;
+            }
+            trace_files[num_traces++] = optarg;
             break;
         case 'v':
             //verbose_mode = 1;
             break;
+        case 'P':
+            profiling = true;
+            break;
+        case 'W':
+            ws_window = atoll(optarg);
+            break;
+        case 'R':
+            sampler.set_sample_rate = atoi(optarg);
+            break;
+        case 'T':
+            //period, warm-up and measured window, all in trace records
+            if (sscanf(optarg, "%lli,%lli,%lli", &sampler.period, &sampler.warmup, &sampler.window) != 3){
+                usage(argv);
+            }
+            break;
+        case 'C':
+            checkpoint_file = optarg;
+            break;
+        case 'K':
+            checkpoint_every = atoll(optarg);
+            break;
+        case 'U':
+            resume_file = optarg;
+            break;
+        case 'A':
+            warm_start_file = optarg;
+            break;
+        case 'F':
+            prefetch_kinds = optarg;
+            break;
+        case 'D':
+            prefetch_degree = atoi(optarg);
+            break;
+        case 'N':
+            num_streams = atoi(optarg);
+            break;
+        case 'L':
+            cache_statistics.prefetch_latency = atoi(optarg);
+            break;
+        case 'V':
+            victim_size = atoi(optarg);
+            break;
+        case 'M':
+            mshr_entries = atoi(optarg);
+            break;
+        case 'O':
+            cache_statistics.mshr_window = atoi(optarg);
+            break;
+        case 'X':
+            tlb_levels = optarg;
+            break;
+        case 'G':
+            page_size = optarg;
+            break;
+        case '2':
+            l2_geometry = optarg;
+            break;
+        case 'I':
+            timing = true;
+            break;
+        case 'Y':
+            latencies = optarg;
+            timing = true;
+            break;
+        case 'Z':
+            bandwidth = atof(optarg);
+            timing = true;
+            break;
+        case 'j':
+            index_scheme = optarg;
+            break;
+        case 'c':
+            partition_ok = parse_way_masks(optarg, class_masks, &num_classes);
+            break;
+        case 'n':
+            default_class = atoi(optarg);
+            break;
+        case 'i':
+            filter_ok = filter_ok && trace_filter_add_range(&filter, optarg, true);
+            break;
+        case 'x':
+            filter_ok = filter_ok && trace_filter_add_range(&filter, optarg, false);
+            break;
+        case 'k':
+            filter_ok = filter_ok && trace_filter_set_markers(&filter, optarg);
+            break;
+        case 'r':
+            filter_ok = filter_ok && trace_filter_set_records(&filter, optarg);
+            break;
+        case 'o':
+            filter_ok = filter_ok && trace_filter_set_ops(&filter, optarg);
+            break;
+        case 'q':
+            schedule_spec = optarg;
+            break;
+        case 'z':
+            parse_only = true;
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -761,18 +3108,115 @@ int main(int argc, char **argv)
             exit(1);
         }
     }
-    //checks to make sure that the user has not entered invalid values for s, E, b, and the trace_file
-    if (cache_statistics.s == 0 || 
+    //-S and -B override -s and -b; s and b become the number of bits needed to count that many sets and bytes
+    if (sets_given < 0 || block_size_given < 0 || sets_given > (1LL << 30) || block_size_given > (1LL << 30)) {
+        printf("%s: Invalid set count or block size\n", argv[0]);
+        usage(argv);
+        exit(1);
+    }
+    if (sets_given > 0){
+    	cache_statistics.s = 0;
+    	while ((1LL << cache_statistics.s) < sets_given){
+    		cache_statistics.s++;
+    	}
+    }
+    if (block_size_given > 0){
+    	cache_statistics.b = 0;
+    	while ((1LL << cache_statistics.b) < block_size_given){
+    		cache_statistics.b++;
+    	}
+    }
+    bool divide_geometry = (sets_given > 0 && sets_given != (1LL << cache_statistics.s)) ||
+    					   (block_size_given > 0 && block_size_given != (1LL << cache_statistics.b));
+
+    //checks to make sure that the user has not entered invalid values for s, E, b, and the trace_file. -S 1 and -B 1
+    //are valid and give s or b of 0, so a geometry given with -S or -B is checked by the set count or block size
+    if ((cache_statistics.s == 0 && sets_given == 0) || 
     	cache_statistics.E == 0 || 
-    	cache_statistics.b == 0 || 
-    	trace_file == NULL || 
-    	cache_statistics.E > 8 || 
-    	!(is_power_of_two(cache_statistics.E))) {
+    	(cache_statistics.b == 0 && block_size_given == 0) || 
+    	num_traces == 0 || 
+    	!(is_power_of_two(cache_statistics.E)) ||
+    	ws_window <= 0) {
     	//display error message and exit with code 1
         printf("%s: Missing required command line argument\n", argv[0]);
         usage(argv);
         exit(1);
     }
+    //the two sampling modes estimate different things and cannot be combined
+    if (sampler.set_sample_rate < 0 ||
+    	(sampler.set_sample_rate > 1 && sampler.period > 0) ||
+    	(sampler.period > 0 && (sampler.warmup < 0 || sampler.window <= 0 || sampler.warmup + sampler.window > sampler.period))) {
+        printf("%s: Invalid sampling parameters\n", argv[0]);
+        usage(argv);
+        exit(1);
+    }
+    //a resumed run keeps checkpointing to the file it came from
+    if (resume_file != NULL && checkpoint_file == NULL){
+    	checkpoint_file = resume_file;
+    }
+    if (index_scheme != NULL && !parse_index_scheme(index_scheme, &cache_statistics)) {
+        printf("%s: Invalid index function\n", argv[0]);
+        usage(argv);
+        exit(1);
+    }
+    if (divide_geometry){
+    	//the hashed index functions and the prefetchers work on power of two sets and blocks
+    	if (cache_statistics.index_scheme != INDEX_MODULO || prefetch_kinds != NULL){
+    		printf("%s: A set count or block size that is not a power of two cannot be combined with --index or --prefetch\n", argv[0]);
+    		usage(argv);
+    		exit(1);
+    	}
+    	cache_statistics.index_scheme = INDEX_DIVIDE;
+    }
+    //the prefetcher, victim cache and MSHR models work on one set per block
+    if (cache_statistics.index_scheme == INDEX_SKEWED && (prefetch_kinds != NULL || victim_size > 0 || mshr_entries > 0)) {
+        printf("%s: Skewed indexing cannot be combined with prefetching, a victim cache or MSHRs\n", argv[0]);
+        usage(argv);
+        exit(1);
+    }
+    //every class needs ways of its own inside the cache; partitioning assumes one set per block and counts every access
+    if (!partition_ok || (num_classes > 0 && (default_class < 0 || default_class >= num_classes ||
+    	cache_statistics.E > 32 || cache_statistics.index_scheme == INDEX_SKEWED || sampler.set_sample_rate > 1 || sampler.period > 0))) {
+        printf("%s: Invalid cache partitioning parameters\n", argv[0]);
+        usage(argv);
+        exit(1);
+    }
+    for (int i = 0; i < num_classes; i++){
+    	if (cache_statistics.E < 32 && (class_masks[i] >> cache_statistics.E) != 0){
+    		printf("%s: Way mask %x of class %d does not fit in %d ways\n", argv[0], class_masks[i], i, cache_statistics.E);
+    		exit(1);
+    	}
+    }
+    if (!filter_ok) {
+        printf("%s: Invalid trace filter\n", argv[0]);
+        usage(argv);
+        exit(1);
+    }
+    if (!traces_ok || (schedule_spec != NULL && !parse_schedule(schedule_spec, &schedule, weights, num_traces))) {
+        printf("%s: Invalid trace schedule (at most %d traces)\n", argv[0], TRACE_MAX_SOURCES);
+        usage(argv);
+        exit(1);
+    }
+    for (int i = 0; i < num_traces; i++){
+    	filters[i] = filter;
+    }
+    if (victim_size < 0 || mshr_entries < 0 || cache_statistics.mshr_window < 0) {
+        printf("%s: Invalid victim cache or MSHR parameters\n", argv[0]);
+        usage(argv);
+        exit(1);
+    }
+    //only the cache itself, the sampling state and one trace position are part of a checkpoint, not the filter's
+    //position in the trace or where the other traces of a replay are
+    bool extra_state = profiling || prefetch_kinds != NULL || victim_size > 0 || mshr_entries > 0 || tlb_levels != NULL ||
+    				   l2_geometry != NULL || timing || filter.active || cache_statistics.index_scheme != INDEX_MODULO ||
+    				   num_classes > 0 || num_traces > 1;
+    if (checkpoint_every <= 0 ||
+    	(resume_file != NULL && warm_start_file != NULL) ||
+    	(extra_state && (checkpoint_file != NULL || resume_file != NULL))) {
+        printf("%s: Invalid checkpoint parameters\n", argv[0]);
+        usage(argv);
+        exit(1);
+    }
 
    	//set the values of previously declared variables
 
@@ -780,6 +3224,15 @@ int main(int argc, char **argv)
     num_sets = pow(2.0, cache_statistics.s);
     //block_size = 2^b
     block_size = pow(2.0, cache_statistics.b);
+    //unless they were given directly
+    if (divide_geometry){
+    	num_sets = sets_given > 0 ? sets_given : num_sets;
+    	block_size = block_size_given > 0 ? block_size_given : block_size;
+    	cache_statistics.block_divider = make_divider(block_size);
+    	cache_statistics.set_divider = make_divider(num_sets);
+    }
+    cache_statistics.S = (int) num_sets;
+    cache_statistics.B = (int) block_size;
     //Zero out the counts of num_hits, num_misses, and num_evictions to start with
     cache_statistics.num_hits = 0;
     cache_statistics.num_misses = 0;
@@ -789,14 +3242,182 @@ int main(int argc, char **argv)
     //run cache initialization function that will build an empty cache according to user specifications
     this_cache = initialize_cache(num_sets, cache_statistics.E, block_size);
 
-    //set the file pointer to point to the open trace_file
-    file_pointer = fopen(trace_file,"r");
+    if (profiling){
+    	profile_init(&profile, ws_window);
+    }
+    init_sampling(&sampler, num_sets);
+
+    if (tlb_levels != NULL && !tlb_init(&translation, tlb_levels, page_size)){
+    	printf("%s: Invalid TLB parameters\n", argv[0]);
+    	usage(argv);
+    	exit(1);
+    }
+
+    if (l2_geometry != NULL){
+    	if (sscanf(l2_geometry, "%d,%d,%d", &l2_statistics.s, &l2_statistics.E, &l2_statistics.b) != 3 ||
+    		l2_statistics.s < 0 || l2_statistics.E <= 0 || l2_statistics.b < 0 || l2_statistics.s + l2_statistics.b >= 64){
+    		printf("%s: Invalid L2 geometry\n", argv[0]);
+    		usage(argv);
+    		exit(1);
+    	}
+    	l2_num_sets = 1LL << l2_statistics.s;
+    	l2_cache = initialize_cache(l2_num_sets, l2_statistics.E, 1LL << l2_statistics.b);
+    }
+    if (timing && !timing_init(&timer, latencies, bandwidth, (int) block_size)){
+    	printf("%s: Invalid timing parameters\n", argv[0]);
+    	usage(argv);
+    	exit(1);
+    }
+
+    //everything an access passes through besides the cache itself
+    simulation_hooks hooks;
+    hooks.sampler = &sampler;
+    hooks.measuring = true;
+    hooks.profile = profiling ? &profile : NULL;
+    hooks.pf = prefetch_kinds != NULL ? &pf : NULL;
+    hooks.translation = tlb_levels != NULL ? &translation : NULL;
+    hooks.l2_cache = l2_geometry != NULL ? &l2_cache : NULL;
+    hooks.l2_statistics = &l2_statistics;
+    hooks.timing = timing ? &timer : NULL;
+    hooks.op = OP_LOAD;
+    hooks.run.valid = false;
+    hooks.run.block = 0;
+
+    if (victim_size > 0){
+    	this_cache.victim_size = victim_size;
+    	this_cache.victim_blocks = (memory_address*) calloc(victim_size, sizeof(memory_address));
+    	this_cache.victim_last_use = (long long*) calloc(victim_size, sizeof(long long));
+    }
+    if (mshr_entries > 0){
+    	this_cache.mshr_entries = mshr_entries;
+    	this_cache.mshr_ready = (long long*) calloc(mshr_entries, sizeof(long long));
+    }
+
+    if (prefetch_kinds != NULL){
+    	if (!prefetcher_init(&pf, prefetch_kinds, prefetch_degree, num_streams, cache_statistics.b) ||
+    		cache_statistics.prefetch_latency < 0){
+    		printf("%s: Invalid prefetch parameters\n", argv[0]);
+    		usage(argv);
+    		exit(1);
+    	}
+    	this_cache.prefetch_victims = (memory_address*) calloc(PREFETCH_VICTIMS, sizeof(memory_address));
+    }
+    bool sampling = sampler.set_sample_rate > 1 || sampler.period > 0;
+    hooks.sampling = sampling;
+    //time sampling jumps over the skipped part of a period by byte offset when nothing needs the records in it one by one:
+    //a single trace read in order, no filter counting records and no checkpoint counting them
+    bool skip_bytes = sampler.period > 0 && num_traces == 1 && schedule != SCHEDULE_TIMESTAMP && !filters[0].active &&
+    				  checkpoint_file == NULL && resume_file == NULL;
+    //repeated hits can only be collapsed when nothing but the hit and sampling counts see them
+    hooks.run_length = !profiling && prefetch_kinds == NULL && victim_size == 0 && mshr_entries == 0 &&
+    				   tlb_levels == NULL && l2_geometry == NULL && !timing;
+    //the kernels fill any way, a partitioned cache goes through run_simulation
+    hooks.kernel = num_classes > 0 ? run_simulation : select_kernel(cache_statistics);
+
+    //map the trace files
+    bool trace_opened = trace_merger_open(&merger, trace_files, num_traces, schedule, weights);
+
+    //pick up a saved run, which has to be on the trace it was saved from, or just its warmed-up cache contents
+    if (resume_file != NULL || warm_start_file != NULL){
+    	bool resuming = resume_file != NULL;
+    	if (!load_checkpoint(resuming ? resume_file : warm_start_file, this_cache, &cache_statistics, num_sets,
+    						 &sampler, resuming, trace_opened ? &merger.readers[0] : NULL, &trace_offset, &records_read)){
+    		exit(1);
+    	}
+    }
 
     
     //start reading in data from the file:
-   	if (file_pointer != NULL) {
-   		//as long as the values for interaction_type, address, and size keep coming in, keep reading them
-        while (fscanf(file_pointer, " %c %llx,%d", &interaction_type, &address, &size) == 3) {
+   	if (trace_opened) {
+   		//a resumed run continues right after the last checkpointed record
+   		if (trace_offset > 0 && !trace_seek(&merger.readers[0], trace_offset)){
+   			printf("%s: Unable to seek to offset %lli in %s\n", argv[0], trace_offset, trace_files[0]);
+   			exit(1);
+   		}
+   		//read the trace one record (line) at a time
+        while ((line = trace_merger_next(&merger, &source, &line_offset)) != NULL) {
+        	//save the state every checkpoint_every records, before this record is simulated
+        	if (checkpoint_file != NULL && records_read > 0 && records_read % checkpoint_every == 0){
+        		if (!save_checkpoint(checkpoint_file, this_cache, cache_statistics, num_sets, &sampler, &merger.readers[0],
+        							 line_offset, records_read)){
+        			printf("%s: Unable to write checkpoint %s\n", argv[0], checkpoint_file);
+        		}
+        	}
+        	records_read++;
+
+        	//the ingest filters see every record, sampling then works on the records they keep
+        	bool parsed = false;
+        	trace_filter* source_filter = &filters[source];
+        	if (source_filter->active){
+        		if (!read_record(&merger.readers[source], line, &interaction_type, &address, &size, &class_id)){
+        			continue;
+        		}
+        		if (!trace_filter_accept(source_filter, interaction_type, address)){
+        			//past the end marker or the last record: nothing more to read from this trace
+        			if (source_filter->finished){
+        				trace_merger_finish(&merger, source);
+        			}
+        			continue;
+        		}
+        		parsed = true;
+        	}
+
+        	//time sampling: position of this record within its period decides if it is skipped, warms the cache, or is measured
+        	bool measuring = true;
+        	if (sampler.period > 0){
+        		long long position = sampler.records % sampler.period;
+        		//a new period starts, the previous period's measured window is complete
+        		if (position == 0 && sampler.records > 0){
+        			close_sample_window(&sampler);
+        		}
+        		sampler.records++;
+        		if (position >= sampler.warmup + sampler.window){
+        			//skipped records are not even parsed, and the rest of them are jumped over from this one on, guessing
+        			//their length from the records parsed so far
+        			if (skip_bytes){
+        				long long skipped = sampler.period - position;
+        				sampler.skipped_bytes += trace_skip(&merger.readers[0], line_offset,
+        													 skipped * sampler.parsed_bytes / sampler.parsed_records);
+        				sampler.records += skipped - 1;
+        			}
+        			continue;
+        		}
+        		measuring = position >= sampler.warmup;
+        		sampler.parsed_records++;
+        		sampler.parsed_bytes += (long long) merger.readers[source].next - line_offset;
+        	}
+        	hooks.measuring = measuring;
+        	//pull out the values for interaction_type, address, and size, skip lines that are not records
+        	if (!parsed && !read_record(&merger.readers[source], line, &interaction_type, &address, &size, &class_id)){
+        		continue;
+        	}
+        	if (parse_only){
+        		continue;
+        	}
+        	//set sampling drops the records of the sets it does not simulate before they reach the cache, so they cost
+        	//little more than their parsing; with run-length compression on no other model needs to see them either
+        	if (hooks.run_length && sampler.set_sample_rate > 1 &&
+        		!sampler.set_sampled[find_set_index(cache_statistics, address)]){
+        		sampler.total_accesses += interaction_type == 'M' ? 2 : (interaction_type == 'I' ? 0 : 1);
+        		if (source_filter->finished){
+        			trace_merger_finish(&merger, source);
+        		}
+        		continue;
+        	}
+        	hooks.op = interaction_type == 'S' ? OP_STORE : (interaction_type == 'M' ? OP_MODIFY : OP_LOAD);
+        	//the record's class decides which ways its misses may fill; classes without a mask fall back to the default,
+        	//and records of a replay that do not give one are in the class numbered after their trace
+        	int record_class = default_class;
+        	long long previous_hits = cache_statistics.num_hits;
+        	long long previous_misses = cache_statistics.num_misses;
+        	long long previous_evictions = cache_statistics.num_evictions;
+        	if (num_classes > 0){
+        		if (class_id < 0 && num_traces > 1 && source < num_classes){
+        			class_id = source;
+        		}
+        		record_class = class_id >= 0 && class_id < num_classes ? class_id : default_class;
+        		cache_statistics.way_mask = class_masks[record_class];
+        	}
         	//differentiate simulation based on interaction_type
             switch(interaction_type) {
             	//Instruction load is to be ignored. No simulation here.
@@ -804,39 +3425,116 @@ int main(int argc, char **argv)
                 break;
                 //Load interacts with cache once, simulate once.
                 case 'L':
-                    cache_statistics = run_simulation(this_cache, cache_statistics, address);
+                    cache_statistics = process_access(this_cache, cache_statistics, address, &hooks);
                 break;
                 //Store interacts with cache once, simulate once.
                 case 'S':
-                    cache_statistics = run_simulation(this_cache, cache_statistics, address);
+                    cache_statistics = process_access(this_cache, cache_statistics, address, &hooks);
                 break;
                 //Modify interacts with cache twice:
                 //Once for the load.
                 //Once for the modify.
                 //Simulate twice.
                 case 'M':
-                    cache_statistics = run_simulation(this_cache, cache_statistics, address);
-                    cache_statistics = run_simulation(this_cache, cache_statistics, address);	
+                    cache_statistics = process_access(this_cache, cache_statistics, address, &hooks);
+                    cache_statistics = process_access(this_cache, cache_statistics, address, &hooks);
                 break;
                 //default condition for safety
                 default:
                 break;
             }
+            if (num_classes > 0){
+            	class_hits[record_class] += cache_statistics.num_hits - previous_hits;
+            	class_misses[record_class] += cache_statistics.num_misses - previous_misses;
+            	class_evictions[record_class] += cache_statistics.num_evictions - previous_evictions;
+            }
+            trace_hits[source] += cache_statistics.num_hits - previous_hits;
+            trace_misses[source] += cache_statistics.num_misses - previous_misses;
+            trace_evictions[source] += cache_statistics.num_evictions - previous_evictions;
+            //the end marker or the last record of this trace was just simulated
+            if (source_filter->finished){
+            	trace_merger_finish(&merger, source);
+            }
         }
     }
 
+    //sampled runs report their estimate and extrapolate the counts to the whole trace
+    if (sampling){
+    	cache_statistics = finish_sampling(&sampler, cache_statistics, num_sets);
+    }
+
     //print the results of the simulation as per the assignment specifications
     printSummary(cache_statistics.num_hits, cache_statistics.num_misses, cache_statistics.num_evictions);
 
-    //run function to free all heap memory allocated
-    free_allocated_memory(this_cache, num_sets, cache_statistics.E, block_size);
-    //close the file so as not to cause issues
-    fclose(file_pointer);
+    if (prefetch_kinds != NULL){
+    	//accuracy: share of the prefetches that were used, coverage: share of the would-be misses they removed
+    	long long fills = cache_statistics.prefetch_issued;
+    	long long used = cache_statistics.prefetch_useful;
+    	printf("prefetches issued:%lld useful:%lld late:%lld unused:%lld polluting:%lld\n",
+    		   fills, used, cache_statistics.prefetch_late, cache_statistics.prefetch_unused,
+    		   cache_statistics.prefetch_polluting);
+    	printf("prefetch accuracy:%.4f coverage:%.4f\n",
+    		   fills ? (double) used / fills : 0.0,
+    		   (used + cache_statistics.num_misses) ? (double) used / (used + cache_statistics.num_misses) : 0.0);
+    	free(this_cache.prefetch_victims);
+    }
 
-    return 0;
-}
+    if (filter.active){
+    	for (int i = 0; i < num_traces; i++){
+    		trace_filter_print(&filters[i]);
+    	}
+    }
+
+    //what each trace of a replay got out of the shared cache
+    if (num_traces > 1){
+    	for (int i = 0; i < num_traces; i++){
+    		printf("trace %d (%s) hits:%lld misses:%lld evictions:%lld\n", i, trace_files[i], trace_hits[i], trace_misses[i],
+    			   trace_evictions[i]);
+    	}
+    }
+
+    for (int i = 0; i < num_classes; i++){
+    	printf("class %d (ways %x) hits:%lld misses:%lld evictions:%lld\n", i, class_masks[i], class_hits[i], class_misses[i],
+    		   class_evictions[i]);
+    }
+
+    if (l2_geometry != NULL){
+    	printf("L2 hits:%lld misses:%lld evictions:%lld\n", l2_statistics.num_hits, l2_statistics.num_misses, l2_statistics.num_evictions);
+    	free_allocated_memory(l2_cache, l2_num_sets, l2_statistics.E, 1LL << l2_statistics.b);
+    }
+
+    if (timing){
+    	timing_print(&timer);
+    }
+
+    if (tlb_levels != NULL){
+    	tlb_print(&translation);
+    	tlb_free(&translation);
+    }
 
+    if (victim_size > 0 || mshr_entries > 0){
+    	//misses that still had to go all the way to memory
+    	printf("victim hits:%lld mshr merged:%lld mshr stalls:%lld memory fetches:%lld\n",
+    		   cache_statistics.victim_hits, cache_statistics.mshr_merged, cache_statistics.mshr_stalls,
+    		   cache_statistics.num_misses - cache_statistics.victim_hits);
+    	free(this_cache.victim_blocks);
+    	free(this_cache.victim_last_use);
+    	free(this_cache.mshr_ready);
+    }
 
+    if (profiling){
+    	profile_print(&profile, cache_statistics.B);
+    	profile_free(&profile);
+    }
 
+    //run function to free all heap memory allocated
+    free_allocated_memory(this_cache, num_sets, cache_statistics.E, block_size);
+    //unmap the file so as not to cause issues
+    if (trace_opened){
+    	trace_merger_close(&merger);
+    }
 
+    return 0;
+}
 
+#endif /* CSIM_LIBRARY */
@@ -63,27 +63,19 @@ def main():
             print "%s" % (line)
 
     # Check the correctness and performance of the transpose function
-    # 32x32 transpose
+    # on the three sizes at once; test-trans prints one result line per
+    # size, in the order the sizes are given
     print "Part B: Testing transpose function"
-    print "Running ./test-trans -M 32 -N 32"
-    p = subprocess.Popen("./test-trans -M 32 -N 32 | grep TEST_TRANS_RESULTS", 
+    print "Running ./test-trans -M 32 -N 32 -M 64 -N 64 -M 61 -N 67"
+    p = subprocess.Popen("./test-trans -M 32 -N 32 -M 64 -N 64 -M 61 -N 67 | grep TEST_TRANS_RESULTS", 
                          shell=True, stdout=subprocess.PIPE)
     stdout_data = p.communicate()[0]
-    result32 = re.findall(r'(\d+)', stdout_data)
-    
-    # 64x64 transpose
-    print "Running ./test-trans -M 64 -N 64"
-    p = subprocess.Popen("./test-trans -M 64 -N 64 | grep TEST_TRANS_RESULTS", 
-                         shell=True, stdout=subprocess.PIPE)
-    stdout_data = p.communicate()[0]
-    result64 = re.findall(r'(\d+)', stdout_data)
-    
-    # 61x67 transpose
-    print "Running ./test-trans -M 61 -N 67"
-    p = subprocess.Popen("./test-trans -M 61 -N 67 | grep TEST_TRANS_RESULTS", 
-                         shell=True, stdout=subprocess.PIPE)
-    stdout_data = p.communicate()[0]
-    result61 = re.findall(r'(\d+)', stdout_data)
+    results = re.split('\n', stdout_data.strip())
+    while len(results) < 3:
+        results.append("TEST_TRANS_RESULTS=0:0")
+    result32 = re.findall(r'(\d+)', results[0])
+    result64 = re.findall(r'(\d+)', results[1])
+    result61 = re.findall(r'(\d+)', results[2])
     
     # Compute the scores for each step
     csim_cscore  = map(int, resultsim[0:1])
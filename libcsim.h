@@ -0,0 +1,71 @@
+/*
+ * libcsim.h - The cache simulator as a library (make libcsim).
+ *     A handle holds one LRU cache. Callers hand it accesses in
+ *     batches and read the counts back, instead of writing a trace
+ *     file and running csim on it. The csim_* functions below are the
+ *     only global symbols of libcsim.a.
+ */
+
+#ifndef LIBCSIM_H
+#define LIBCSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A 64 bit address, as in the traces */
+typedef unsigned long long addr_t;
+
+/* Operation of each access; a modify is a load followed by a store */
+#define CSIM_OP_LOAD   ((uint8_t) 'L')
+#define CSIM_OP_STORE  ((uint8_t) 'S')
+#define CSIM_OP_MODIFY ((uint8_t) 'M')
+
+typedef struct csim_handle csim_handle;
+
+typedef struct {
+    int s;                          /* set index bits */
+    int E;                          /* lines per set */
+    int b;                          /* block offset bits */
+    long sets;                      /* number of sets instead of 1 << s, need not be a
+                                       power of two; 0 to use s */
+} csim_config;
+
+typedef struct {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+} csim_counts;
+
+/*
+ * csim_create - Build an empty cache. Returns NULL if the geometry is
+ *     not valid or memory runs out.
+ */
+csim_handle* csim_create(const csim_config* config);
+
+/*
+ * csim_access_batch - Simulate n accesses in order. ops may be NULL,
+ *     in which case every access is a load; other op values than L, S
+ *     and M (such as 'I') are skipped.
+ */
+void csim_access_batch(csim_handle* handle, const addr_t* addresses, const uint8_t* ops, size_t n);
+
+/*
+ * csim_access_batch_misses - Like csim_access_batch, and also writes
+ *     the address of every access that missed to misses, in order, so
+ *     they can be handed to a next level cache. misses needs room for n
+ *     addresses (the store of a modify always hits). Returns how many
+ *     were written.
+ */
+size_t csim_access_batch_misses(csim_handle* handle, const addr_t* addresses, const uint8_t* ops, size_t n,
+                                addr_t* misses);
+
+/* csim_stats - Counts so far */
+csim_counts csim_stats(const csim_handle* handle);
+
+/* csim_reset - Empty the cache and zero the counts */
+void csim_reset(csim_handle* handle);
+
+/* csim_destroy - Release the handle */
+void csim_destroy(csim_handle* handle);
+
+#endif /* LIBCSIM_H */
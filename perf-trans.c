@@ -0,0 +1,410 @@
+/*
+ * perf-trans.c - Checks the simulator against the real machine. It runs
+ *     one registered transpose function natively with the hardware
+ *     counters for L1D and last level cache loads and misses (through
+ *     perf_event_open, Linux only), then has test-trans simulate the
+ *     same function's loads through this machine's L1D, L2 and LLC, each
+ *     level seeing only the misses of the one above, and prints the two
+ *     side by side. The matrices are laid out the way
+ *     tracegen lays them out, and the caches are flushed before every
+ *     native run because the simulation starts with empty caches.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "cachelab.h"
+
+/* Native runs per measurement; the counts are averaged */
+#define DEFAULT_REPEATS 5
+
+/* Default alignment of the matrices, as in tracegen and test-trans */
+#define DEFAULT_ALIGNMENT 4096
+
+/* Used when the cache geometry cannot be read from sysfs */
+#define DEFAULT_L1D_SETS 64
+#define DEFAULT_L1D_WAYS 8
+#define DEFAULT_LLC_SETS 8192
+#define DEFAULT_LLC_WAYS 16
+#define DEFAULT_LINE_SIZE 64
+
+/* External functions defined in trans.c and trans_extra.c */
+extern void registerFunctions();
+extern void registerExtraFunctions();
+extern int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+
+/* External variables defined in cachelab.c */
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+/* Most cache levels simulated below the L1D, as test-trans -L allows */
+#define MAX_LOWER_LEVELS 2
+
+/* One cache of this machine */
+struct host_cache {
+    int level;
+    long sets, ways, line_size;
+    int b;                          /* block offset bits it is simulated with */
+};
+
+/* The hardware events counted, in the order they are printed */
+enum event { L1D_LOADS, L1D_MISSES, LLC_LOADS, LLC_MISSES, NUM_EVENTS };
+
+static const char* event_names[NUM_EVENTS] = {"L1D loads", "L1D load misses", "LLC loads", "LLC load misses"};
+
+static const unsigned long long event_configs[NUM_EVENTS] = {
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16),
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16),
+    PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+};
+
+/*
+ * read_long - Read a number from a sysfs file, with an optional K or M
+ *     suffix; -1 if it cannot be read
+ */
+static long read_long(const char* dir, const char* name)
+{
+    char path[256], text[64];
+    char* end;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+    if (fgets(text, sizeof(text), fp) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    long value = strtol(text, &end, 10);
+    if (*end == 'K')
+        value <<= 10;
+    else if (*end == 'M')
+        value <<= 20;
+    return value;
+}
+
+/*
+ * log2_floor - Bits of the largest power of two not above value
+ */
+static int log2_floor(long value)
+{
+    int bits = 0;
+    while (value > 1) {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
+/*
+ * find_caches - Read the L1 data cache, the L2 and the last level cache
+ *     of CPU 0 from sysfs. The set counts are kept as they are; one that
+ *     is not a power of two (common for sliced LLCs) is simulated as it
+ *     is. l2->level is 0 when there is no L2 apart from the LLC.
+ */
+static void find_caches(struct host_cache* l1d, struct host_cache* l2, struct host_cache* llc)
+{
+    char dir[128], path[256], type[32];
+    int i;
+
+    *l1d = (struct host_cache) {1, DEFAULT_L1D_SETS, DEFAULT_L1D_WAYS, DEFAULT_LINE_SIZE, 0};
+    *l2 = (struct host_cache) {0, 0, 0, 0, 0};
+    *llc = (struct host_cache) {0, DEFAULT_LLC_SETS, DEFAULT_LLC_WAYS, DEFAULT_LINE_SIZE, 0};
+    for (i = 0;; i++) {
+        snprintf(dir, sizeof(dir), "/sys/devices/system/cpu/cpu0/cache/index%d", i);
+        long level = read_long(dir, "level");
+        if (level < 0)
+            break;
+        snprintf(path, sizeof(path), "%s/type", dir);
+        FILE* fp = fopen(path, "r");
+        if (fp == NULL || fgets(type, sizeof(type), fp) == NULL) {
+            if (fp != NULL)
+                fclose(fp);
+            continue;
+        }
+        fclose(fp);
+        if (strncmp(type, "Instruction", 11) == 0)
+            continue;
+        struct host_cache found = {(int) level, read_long(dir, "number_of_sets"),
+                                   read_long(dir, "ways_of_associativity"),
+                                   read_long(dir, "coherency_line_size"), 0};
+        if (found.sets <= 0 || found.ways <= 0 || found.line_size <= 0)
+            continue;
+        if (level == 1)
+            *l1d = found;
+        if (level == 2)
+            *l2 = found;
+        if (level >= llc->level)
+            *llc = found;
+    }
+    if (llc->level == 0)
+        llc->level = 3;
+    if (l2->level == llc->level)
+        l2->level = 0;
+
+    /* Lines are a power of two on every machine there is */
+    struct host_cache* caches[3] = {l1d, l2, llc};
+    for (i = 0; i < 3; i++)
+        caches[i]->b = log2_floor(caches[i]->line_size);
+}
+
+/*
+ * open_event - Count one hardware cache event of this thread in user
+ *     mode, starting disabled; -1 if the machine or kernel will not
+ */
+static int open_event(unsigned long long config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    /* The counters may be multiplexed, the times let the count be scaled */
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * read_event - The count of an event, scaled up if it only ran for
+ *     part of the time it was enabled
+ */
+static double read_event(int fd)
+{
+    unsigned long long values[3];
+    if (read(fd, values, sizeof(values)) != sizeof(values) || values[2] == 0)
+        return 0;
+    return (double) values[0] * values[1] / values[2];
+}
+
+/*
+ * flush_caches - Evict the matrices by writing a buffer twice the size
+ *     of the last level cache
+ */
+static void flush_caches(const struct host_cache* llc)
+{
+    static char* buffer = NULL;
+    size_t bytes = 2 * (size_t) llc->sets * llc->ways * llc->line_size;
+    if (buffer == NULL && (buffer = malloc(bytes)) == NULL)
+        return;
+    for (size_t i = 0; i < bytes; i += 64)
+        buffer[i]++;
+    /* Keep the writes from being optimized away */
+    __asm__ volatile("" : : "r"(buffer) : "memory");
+}
+
+/*
+ * simulate - Have one test-trans run simulate the function's loads
+ *     through the num_caches caches, the first with the whole trace and
+ *     each one after it with the misses of the one before. Returns false
+ *     if it could not (test-trans or valgrind missing, or the function
+ *     failed); otherwise every level's counts are filled in.
+ */
+static int simulate(int M, int N, int func, struct host_cache* const caches[], int num_caches,
+                    long alignment, long padding, unsigned long long hits[], unsigned long long misses[])
+{
+    char command[512], line[512], prefix[32];
+    int level, used, found = 0;
+
+    used = snprintf(command, sizeof(command), "./test-trans -M %d -N %d -F %d -l -a %ld -p %ld -S %ld -E %ld -b %d",
+                    M, N, func, alignment, padding, caches[0]->sets, caches[0]->ways, caches[0]->b);
+    for (level = 1; level < num_caches; level++)
+        used += snprintf(command + used, sizeof(command) - used, " -L %ld,%ld,%d",
+                         caches[level]->sets, caches[level]->ways, caches[level]->b);
+    snprintf(command + used, sizeof(command) - used, " 2>&1");
+    snprintf(prefix, sizeof(prefix), "func %d (", func);
+    FILE* fp = popen(command, "r");
+    if (fp == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, prefix, strlen(prefix)) != 0)
+            continue;
+        /* "func 1 (name): hits:..." is the L1D, "func 1 (name) level 2: hits:..." a level below */
+        char* counts = strstr(line, "): hits:");
+        char* lower = strstr(line, ") level ");
+        if (counts != NULL && sscanf(counts, "): hits:%llu, misses:%llu", &hits[0], &misses[0]) == 2)
+            found |= 1;
+        else if (lower != NULL && sscanf(lower, ") level %d:", &level) == 1 && level >= 2 && level <= num_caches &&
+                 sscanf(strstr(lower, ": hits:"), ": hits:%llu, misses:%llu", &hits[level - 1],
+                        &misses[level - 1]) == 2)
+            found |= 1 << (level - 1);
+    }
+    pclose(fp);
+    return found == (1 << num_caches) - 1;
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] -M <cols> -N <rows> [-F <num>] [-r <num>] [-a <bytes>] [-p <bytes>] [-n]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -M <cols>   Number of matrix columns\n");
+    printf("  -N <rows>   Number of matrix rows\n");
+    printf("  -F <num>    Registered function to run (default 0, the submission)\n");
+    printf("  -r <num>    Native runs, the counts are averaged (default %d)\n", DEFAULT_REPEATS);
+    printf("  -a <bytes>  Alignment of the matrices, a power of two (default %d)\n", DEFAULT_ALIGNMENT);
+    printf("  -p <bytes>  Extra distance from the end of A to B (default 0)\n");
+    printf("  -n          Only count natively, do not simulate\n");
+    printf("Example: %s -M 64 -N 64 -F 1\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int M = 0, N = 0, func = 0, repeats = DEFAULT_REPEATS, native_only = 0;
+    long alignment = DEFAULT_ALIGNMENT, padding = 0;
+    int fds[NUM_EVENTS];
+    double counts[NUM_EVENTS] = {0};
+    struct host_cache l1d, l2, llc;
+    int c, e, r, opened = 0;
+
+    while ((c = getopt(argc, argv, "M:N:F:r:a:p:nh")) != -1) {
+        switch (c) {
+        case 'M':
+            M = atoi(optarg);
+            break;
+        case 'N':
+            N = atoi(optarg);
+            break;
+        case 'F':
+            func = atoi(optarg);
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            break;
+        case 'a':
+            alignment = atol(optarg);
+            break;
+        case 'p':
+            padding = atol(optarg);
+            break;
+        case 'n':
+            native_only = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (M <= 0 || N <= 0 || repeats <= 0 || padding < 0 || alignment < (long) sizeof(void*) ||
+        (alignment & (alignment - 1)) != 0) {
+        printf("Error: Missing or bad argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    /* test-trans only has trans.c's functions, so only those can be simulated */
+    registerFunctions();
+    int simulated_functions = func_counter;
+    registerExtraFunctions();
+    if (func < 0 || func >= func_counter) {
+        printf("Error: There are only %d registered functions\n", func_counter);
+        exit(1);
+    }
+    find_caches(&l1d, &l2, &llc);
+
+    /* A and B in one block, B padding bytes past the first aligned address after A, as tracegen does */
+    size_t bytes = sizeof(int) * (size_t) M * N;
+    size_t offset = (bytes + alignment - 1) / alignment * alignment + padding;
+    void* block;
+    if (posix_memalign(&block, alignment, offset + bytes) != 0) {
+        printf("Error: Unable to allocate two %d x %d matrices\n", N, M);
+        exit(1);
+    }
+    int* A = block;
+    int* B = (int*) ((char*) block + offset);
+    initMatrix(M, N, (int (*)[M]) A, (int (*)[N]) B);
+
+    for (e = 0; e < NUM_EVENTS; e++) {
+        fds[e] = open_event(event_configs[e]);
+        if (fds[e] >= 0)
+            opened++;
+    }
+    if (opened == 0)
+        printf("Hardware counters unavailable (%s); check /proc/sys/kernel/perf_event_paranoid\n",
+               strerror(errno));
+
+    int correct = 1;
+    for (r = 0; r < repeats; r++) {
+        if (func_list[func].in_place)
+            memcpy(B, A, bytes);
+        flush_caches(&llc);
+        for (e = 0; e < NUM_EVENTS; e++) {
+            if (fds[e] >= 0) {
+                ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+        (*func_list[func].func_ptr)(M, N, (int (*)[M]) (func_list[func].in_place ? B : A), (int (*)[N]) B);
+        for (e = 0; e < NUM_EVENTS; e++) {
+            if (fds[e] >= 0) {
+                ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+                counts[e] += read_event(fds[e]);
+            }
+        }
+        correct &= is_transpose(M, N, (int (*)[M]) A, (int (*)[N]) B);
+    }
+
+    printf("func %d (%s), %dx%d, correct:%d\n", func, func_list[func].description, N, M, correct);
+    /* Simulated in order: the L1D, the L2 if it is not the LLC, and the LLC */
+    struct host_cache* caches[1 + MAX_LOWER_LEVELS] = {&l1d};
+    const char* names[1 + MAX_LOWER_LEVELS] = {"L1D"};
+    int num_caches = 1;
+    if (l2.level != 0) {
+        names[num_caches] = "L2";
+        caches[num_caches++] = &l2;
+    }
+    names[num_caches] = "LLC";
+    caches[num_caches++] = &llc;
+    for (int i = 0; i < num_caches; i++)
+        printf("%-4s %ld sets, %ld ways, %ld byte lines (L%d), simulated as sets=%ld E=%ld b=%d\n", names[i],
+               caches[i]->sets, caches[i]->ways, caches[i]->line_size, caches[i]->level, caches[i]->sets,
+               caches[i]->ways, caches[i]->b);
+
+    printf("\n%-16s %14s\n", "native", opened > 0 ? "mean per run" : "");
+    for (e = 0; e < NUM_EVENTS; e++) {
+        if (fds[e] >= 0)
+            printf("%-16s %14.0f\n", event_names[e], counts[e] / repeats);
+        else
+            printf("%-16s %14s\n", event_names[e], "n/a");
+    }
+
+    if (!native_only && func >= simulated_functions) {
+        printf("\nNot simulated: func %d is in trans_extra.c, which test-trans does not link\n", func);
+    }
+    else if (!native_only) {
+        unsigned long long hits[1 + MAX_LOWER_LEVELS], misses[1 + MAX_LOWER_LEVELS];
+        printf("\n%-16s %14s %14s %8s\n", "simulated", "loads", "misses", "miss%");
+        if (simulate(M, N, func, caches, num_caches, alignment, padding, hits, misses)) {
+            for (int i = 0; i < num_caches; i++)
+                printf("%-16s %14llu %14llu %7.2f%%\n", names[i], hits[i] + misses[i], misses[i],
+                       hits[i] + misses[i] > 0 ? 100.0 * misses[i] / (hits[i] + misses[i]) : 0.0);
+        }
+        else {
+            printf("%-16s %14s %14s %8s  (is ./test-trans built and valgrind installed?)\n",
+                   "all levels", "n/a", "n/a", "n/a");
+        }
+        printf("\nNative counts include the function's own stack; simulated counts are the loads\n"
+               "of A and B (a modify counts as its load), and each simulated level below the L1D\n"
+               "sees only the misses of the level above it, as the hardware does.\n");
+    }
+
+    for (e = 0; e < NUM_EVENTS; e++)
+        if (fds[e] >= 0)
+            close(fds[e]);
+    free(block);
+    return 0;
+}
@@ -0,0 +1,218 @@
+/*
+* Title: prefetch.c
+*
+* Purpose: prefetch.c models three kinds of hardware prefetcher that watch the demand access stream and pick blocks to
+*	fetch ahead of it:
+*
+*	next-line  on a miss, or on the first hit to a prefetched line (tagged prefetching), fetch the next degree blocks.
+*
+*	stride     a PC-less stride detector. Real hardware keys stride tables by the load's PC, which lackey traces do not
+*	           carry, so the table is keyed by 4KB region instead. Once the same block stride has been seen twice in a
+*	           row within a region, fetch degree strides ahead.
+*
+*	stream     stream buffers. A miss that no stream expects allocates the least recently used stream, which then keeps
+*	           the degree blocks after the demand stream fetched as the stream advances.
+*
+*	The prefetchers work on block addresses and only return candidates; csim fills them into the cache.
+*/
+
+#include "prefetch.h"
+#include <string.h>
+
+
+/* Function to add a candidate block, dropping it if the list is full.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	unsigned long long* candidates --> the candidate list
+*
+*	int count --> number of candidates already in the list
+*
+*	unsigned long long block --> the block to add
+*
+*	=======
+*	Returns
+*	=======
+*
+*	int, the new number of candidates
+*/
+static int add_candidate(unsigned long long* candidates, int count, unsigned long long block){
+	if (count < PREFETCH_MAX_CANDIDATES){
+		candidates[count++] = block;
+	}
+	return count;
+}
+
+
+bool prefetcher_init(prefetcher* pf, const char* kinds, int degree, int num_streams, int block_bits){
+	memset(pf, 0, sizeof(prefetcher));
+	pf->degree = degree;
+	pf->num_streams = num_streams;
+	pf->block_bits = block_bits;
+	if (degree < 1 || degree > PREFETCH_MAX_CANDIDATES || num_streams < 1 || num_streams > MAX_STREAMS){
+		return false;
+	}
+
+	//walk the comma separated list of prefetcher names
+	while (*kinds != '\0'){
+		const char* end = strchr(kinds, ',');
+		size_t length = end ? (size_t) (end - kinds) : strlen(kinds);
+		if (length == 9 && strncmp(kinds, "next-line", 9) == 0){
+			pf->kinds |= PREFETCH_NEXT_LINE;
+		}
+		else if (length == 6 && strncmp(kinds, "stride", 6) == 0){
+			pf->kinds |= PREFETCH_STRIDE;
+		}
+		else if (length == 6 && strncmp(kinds, "stream", 6) == 0){
+			pf->kinds |= PREFETCH_STREAM;
+		}
+		else {
+			return false;
+		}
+		kinds += length;
+		if (*kinds == ','){
+			kinds++;
+		}
+	}
+	return pf->kinds != 0;
+}
+
+
+/* Function to run the stride detector on one demand access.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	prefetcher* pf --> the prefetcher state
+*
+*	unsigned long long block --> the demanded block
+*
+*	unsigned long long* candidates --> the candidate list to add to
+*
+*	int count --> number of candidates already in the list
+*
+*	=======
+*	Returns
+*	=======
+*
+*	int, the new number of candidates
+*/
+static int observe_stride(prefetcher* pf, unsigned long long block, unsigned long long* candidates, int count){
+	//one entry per 4KB region, direct mapped
+	int shift = 12 - pf->block_bits;
+	unsigned long long region = shift > 0 ? block >> shift : block;
+	stride_entry* entry = &pf->strides[region % STRIDE_TABLE_SIZE];
+
+	if (!entry->valid || entry->region != region){
+		entry->valid = true;
+		entry->region = region;
+		entry->last_block = block;
+		entry->stride = 0;
+		entry->confidence = 0;
+		return count;
+	}
+	//accesses inside the block last seen say nothing about the stride
+	if (block == entry->last_block){
+		return count;
+	}
+
+	long long stride = (long long) (block - entry->last_block);
+	if (stride == entry->stride){
+		if (entry->confidence < 3){
+			entry->confidence++;
+		}
+	}
+	else {
+		entry->stride = stride;
+		entry->confidence = 0;
+	}
+	entry->last_block = block;
+
+	//the stride repeated twice in a row: fetch ahead along it
+	if (entry->confidence >= 2){
+		for (int k = 1; k <= pf->degree; k++){
+			count = add_candidate(candidates, count, block + (unsigned long long) (stride * k));
+		}
+	}
+	return count;
+}
+
+
+/* Function to advance or allocate stream buffers on one demand access.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	prefetcher* pf --> the prefetcher state
+*
+*	unsigned long long block --> the demanded block
+*
+*	bool miss --> true if the access missed, only misses allocate new streams
+*
+*	unsigned long long* candidates --> the candidate list to add to
+*
+*	int count --> number of candidates already in the list
+*
+*	=======
+*	Returns
+*	=======
+*
+*	int, the new number of candidates
+*/
+static int observe_stream(prefetcher* pf, unsigned long long block, bool miss, unsigned long long* candidates, int count){
+	int lru = 0;
+	for (int i = 0; i < pf->num_streams; i++){
+		stream_buffer* stream = &pf->streams[i];
+		//the demand stream reached a block this stream fetched: move the window up behind it
+		if (stream->valid && block >= stream->head && block < stream->fetched){
+			stream->head = block + 1;
+			stream->last_use = pf->clock;
+			while (stream->fetched < stream->head + pf->degree){
+				count = add_candidate(candidates, count, stream->fetched++);
+			}
+			return count;
+		}
+		//replace an unused stream first, otherwise the least recently used one
+		if (pf->streams[lru].valid && (!stream->valid || stream->last_use < pf->streams[lru].last_use)){
+			lru = i;
+		}
+	}
+
+	//a miss no stream expected starts a new stream right after it
+	if (miss){
+		stream_buffer* stream = &pf->streams[lru];
+		stream->valid = true;
+		stream->head = block + 1;
+		stream->fetched = block + 1;
+		stream->last_use = pf->clock;
+		while (stream->fetched < stream->head + pf->degree){
+			count = add_candidate(candidates, count, stream->fetched++);
+		}
+	}
+	return count;
+}
+
+
+int prefetcher_observe(prefetcher* pf, unsigned long long block, bool miss, bool prefetched_hit,
+					   unsigned long long* candidates){
+	int count = 0;
+	pf->clock++;
+
+	//tagged next-line: the first use of a prefetched line keeps the sequence going
+	if ((pf->kinds & PREFETCH_NEXT_LINE) && (miss || prefetched_hit)){
+		for (int k = 1; k <= pf->degree; k++){
+			count = add_candidate(candidates, count, block + k);
+		}
+	}
+	if (pf->kinds & PREFETCH_STRIDE){
+		count = observe_stride(pf, block, candidates, count);
+	}
+	if (pf->kinds & PREFETCH_STREAM){
+		count = observe_stream(pf, block, miss, candidates, count);
+	}
+	return count;
+}
@@ -0,0 +1,67 @@
+/*
+ * prefetch.h - Hardware prefetcher models used by csim (--prefetch).
+ *     The prefetchers only decide which blocks to fetch; csim fills
+ *     them into the cache and keeps the useful/late/polluting counts.
+ */
+
+#ifndef CSIM_PREFETCH_H
+#define CSIM_PREFETCH_H
+
+#include <stdbool.h>
+
+/* Prefetcher kinds, combined as a bit mask */
+#define PREFETCH_NEXT_LINE 1
+#define PREFETCH_STRIDE    2
+#define PREFETCH_STREAM    4
+
+/* Most blocks a single access can ask for */
+#define PREFETCH_MAX_CANDIDATES 64
+
+/* Size of the stride detector's region table and of the stream table */
+#define STRIDE_TABLE_SIZE 16
+#define MAX_STREAMS 32
+
+/* Stride detector entry, one per recently touched 4KB region */
+typedef struct {
+    unsigned long long region;      /* address >> 12 of the region, valid if confidence >= 0 */
+    unsigned long long last_block;  /* last block demanded in the region */
+    long long stride;               /* last block stride seen in the region */
+    int confidence;                 /* number of times in a row the stride repeated */
+    bool valid;
+} stride_entry;
+
+/* Stream buffer: a run of ascending blocks fetched ahead of the demand stream */
+typedef struct {
+    unsigned long long head;        /* next block the demand stream is expected to touch */
+    unsigned long long fetched;     /* one past the last block prefetched for this stream */
+    unsigned long long last_use;    /* for replacing the least recently used stream */
+    bool valid;
+} stream_buffer;
+
+typedef struct {
+    int kinds;                      /* bit mask of PREFETCH_* */
+    int degree;                     /* lines ahead (next-line), strides ahead (stride), depth (stream) */
+    int block_bits;                 /* b, to find the 4KB region of a block */
+    stride_entry strides[STRIDE_TABLE_SIZE];
+    stream_buffer streams[MAX_STREAMS];
+    int num_streams;
+    unsigned long long clock;
+} prefetcher;
+
+/*
+ * prefetcher_init - Set up the prefetchers named in the comma separated
+ *     list (next-line, stride, stream). Returns false on an unknown name
+ *     or an out of range degree or stream count.
+ */
+bool prefetcher_init(prefetcher* pf, const char* kinds, int degree, int num_streams, int block_bits);
+
+/*
+ * prefetcher_observe - Show a demand access to the prefetchers. miss is
+ *     true on a demand miss, prefetched_hit on the first demand hit to a
+ *     prefetched line. Fills candidates with the block addresses to
+ *     prefetch and returns how many there are.
+ */
+int prefetcher_observe(prefetcher* pf, unsigned long long block, bool miss, bool prefetched_hit,
+                       unsigned long long* candidates);
+
+#endif /* CSIM_PREFETCH_H */
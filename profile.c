@@ -0,0 +1,385 @@
+/*
+* Title: profile.c
+*
+* Purpose: profile.c computes the exact reuse distance (LRU stack distance) of every access in a trace and a windowed
+*	working-set curve. The reuse distance of an access is the number of distinct blocks touched since the previous access
+*	to the same block, so a fully associative LRU cache of C lines hits exactly the accesses with a distance below C. This
+*	lets a single pass over a trace predict the miss ratio of every cache size.
+*
+*	Distances are found in O(log n) per access with a Fenwick (binary indexed) tree over access times in which only the most
+*	recent access of each block is marked: the distance is the number of marks after the block's previous access. The time
+*	axis is compacted whenever it fills up, so memory stays proportional to the number of distinct blocks rather than to
+*	the length of the trace.
+*/
+
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//initial number of hash table slots and Fenwick positions, both grow on demand
+#define PROFILE_INITIAL_SIZE 1024
+
+
+/* Function to hash a block address into the profile's hash table.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	unsigned long long block --> the block address to hash
+*
+*	long long table_size --> number of slots in the table, a power of two
+*
+*	=======
+*	Returns
+*	=======
+*
+*	long long, the slot the probe sequence for this block starts at
+*/
+static long long hash_block(unsigned long long block, long long table_size){
+	//fibonacci hashing, keep the well mixed high bits
+	unsigned long long hash = block * 0x9E3779B97F4A7C15ULL;
+	return (long long) ((hash ^ (hash >> 29)) & (unsigned long long) (table_size - 1));
+}
+
+
+/* Function to add a value at one position of the Fenwick tree.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	reuse_profile* profile --> the profile holding the tree
+*
+*	long long position --> 1-based time position to update
+*
+*	int delta --> +1 to mark the position, -1 to clear it
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void fenwick_add(reuse_profile* profile, long long position, int delta){
+	for (; position <= profile->capacity; position += position & -position){
+		profile->tree[position] += delta;
+	}
+}
+
+
+/* Function to count the marked positions in [1, position] of the Fenwick tree.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	reuse_profile* profile --> the profile holding the tree
+*
+*	long long position --> 1-based inclusive upper bound
+*
+*	=======
+*	Returns
+*	=======
+*
+*	long long, number of marks at or before position
+*/
+static long long fenwick_prefix(reuse_profile* profile, long long position){
+	long long sum = 0;
+	for (; position > 0; position -= position & -position){
+		sum += profile->tree[position];
+	}
+	return sum;
+}
+
+
+/* Function to renumber the live marks to 1..num_blocks, keeping their order, and rebuild the Fenwick tree. Doubles the
+*  time axis first if more than half of it is live, so compactions stay amortized O(1) per access.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	reuse_profile* profile --> the profile whose time axis is full
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void compact_time_axis(reuse_profile* profile){
+	long long new_capacity = profile->capacity;
+	//grow when the live marks would fill more than half of the axis again
+	if (profile->num_blocks * 2 > profile->capacity){
+		new_capacity = profile->capacity * 2;
+	}
+
+	long long* new_owner = (long long*) malloc(sizeof(long long) * (new_capacity + 1));
+	int* new_tree = (int*) calloc(new_capacity + 1, sizeof(int));
+
+	//walk the old axis in time order and hand out consecutive positions to the live marks
+	long long next = 0;
+	for (long long t = 1; t < profile->now; t++){
+		long long slot = profile->owner[t];
+		if (slot >= 0){
+			next++;
+			new_owner[next] = slot;
+			profile->table[slot].last_time = next;
+		}
+	}
+	for (long long t = next + 1; t <= new_capacity; t++){
+		new_owner[t] = -1;
+	}
+
+	//positions 1..next are all marked, build the tree in linear time
+	for (long long t = 1; t <= new_capacity; t++){
+		new_tree[t] += (t <= next) ? 1 : 0;
+		long long parent = t + (t & -t);
+		if (parent <= new_capacity){
+			new_tree[parent] += new_tree[t];
+		}
+	}
+
+	free(profile->owner);
+	free(profile->tree);
+	profile->owner = new_owner;
+	profile->tree = new_tree;
+	profile->capacity = new_capacity;
+	profile->now = next + 1;
+}
+
+
+/* Function to double the hash table and re-point the Fenwick owners at the new slots.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	reuse_profile* profile --> the profile whose table is half full
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void grow_table(reuse_profile* profile){
+	long long new_size = profile->table_size * 2;
+	profile_entry* new_table = (profile_entry*) calloc(new_size, sizeof(profile_entry));
+
+	for (long long i = 0; i < profile->table_size; i++){
+		profile_entry entry = profile->table[i];
+		if (entry.last_time == 0){
+			continue;
+		}
+		long long slot = hash_block(entry.block, new_size);
+		while (new_table[slot].last_time != 0){
+			slot = (slot + 1) & (new_size - 1);
+		}
+		new_table[slot] = entry;
+		//the mark at last_time now belongs to the new slot
+		profile->owner[entry.last_time] = slot;
+	}
+
+	free(profile->table);
+	profile->table = new_table;
+	profile->table_size = new_size;
+}
+
+
+/* Function to return the log2 bin a distance or size falls into: 0 for 0, k for [2^(k-1), 2^k - 1].
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	unsigned long long value --> the value to bin
+*
+*	=======
+*	Returns
+*	=======
+*
+*	int, the bin index between 0 and PROFILE_BINS - 1
+*/
+static int log2_bin(unsigned long long value){
+	int bin = 0;
+	while (value != 0){
+		bin++;
+		value >>= 1;
+	}
+	return bin;
+}
+
+
+/* Function to close the current working-set window and record its size.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	reuse_profile* profile --> the profile whose window just ended
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void close_window(reuse_profile* profile){
+	if (profile->ws_count == profile->ws_size){
+		profile->ws_size *= 2;
+		profile->ws_curve = (long long*) realloc(profile->ws_curve, sizeof(long long) * profile->ws_size);
+	}
+	profile->ws_curve[profile->ws_count++] = profile->ws_current;
+	profile->ws_hist[log2_bin(profile->ws_current)]++;
+	profile->ws_current = 0;
+}
+
+
+void profile_init(reuse_profile* profile, long long ws_window){
+	memset(profile, 0, sizeof(reuse_profile));
+
+	profile->table_size = PROFILE_INITIAL_SIZE;
+	profile->table = (profile_entry*) calloc(profile->table_size, sizeof(profile_entry));
+
+	profile->capacity = PROFILE_INITIAL_SIZE;
+	profile->tree = (int*) calloc(profile->capacity + 1, sizeof(int));
+	profile->owner = (long long*) malloc(sizeof(long long) * (profile->capacity + 1));
+	for (long long t = 0; t <= profile->capacity; t++){
+		profile->owner[t] = -1;
+	}
+	profile->now = 1;
+
+	profile->ws_window = ws_window;
+	profile->ws_size = 64;
+	profile->ws_curve = (long long*) malloc(sizeof(long long) * profile->ws_size);
+}
+
+
+void profile_access(reuse_profile* profile, unsigned long long block){
+	//make room on the time axis before placing this access
+	if (profile->now > profile->capacity){
+		compact_time_axis(profile);
+	}
+	//keep the table at most half full so probe sequences stay short
+	if ((profile->num_blocks + 1) * 2 > profile->table_size){
+		grow_table(profile);
+	}
+
+	//find the block's slot, or the empty slot it belongs in
+	long long slot = hash_block(block, profile->table_size);
+	while (profile->table[slot].last_time != 0 && profile->table[slot].block != block){
+		slot = (slot + 1) & (profile->table_size - 1);
+	}
+	profile_entry* entry = &profile->table[slot];
+
+	//window index of this access, used to count each block once per window
+	long long window = (long long) (profile->accesses / profile->ws_window) + 1;
+
+	if (entry->last_time == 0){
+		//first touch of the block: infinite reuse distance
+		entry->block = block;
+		entry->last_window = 0;
+		profile->num_blocks++;
+		profile->cold++;
+	}
+	else {
+		//every mark after the previous access is a distinct block touched in between
+		long long distance = profile->num_blocks - fenwick_prefix(profile, entry->last_time);
+		profile->reuse_hist[log2_bin(distance)]++;
+		//the old access is no longer the block's latest
+		fenwick_add(profile, entry->last_time, -1);
+		profile->owner[entry->last_time] = -1;
+	}
+
+	//mark this access as the block's latest
+	entry->last_time = profile->now;
+	profile->owner[profile->now] = slot;
+	fenwick_add(profile, profile->now, 1);
+	profile->now++;
+
+	//working-set accounting
+	if (entry->last_window != window){
+		entry->last_window = window;
+		profile->ws_current++;
+	}
+	profile->accesses++;
+	if (profile->accesses % profile->ws_window == 0){
+		close_window(profile);
+	}
+}
+
+
+void profile_print(reuse_profile* profile, long long block_size){
+	//a trailing partial window still counts as a point on the curve
+	if (profile->ws_current > 0){
+		close_window(profile);
+	}
+
+	int last_bin = 0;
+	for (int i = 0; i < PROFILE_BINS; i++){
+		if (profile->reuse_hist[i] != 0){
+			last_bin = i;
+		}
+	}
+
+	printf("\nReuse distance histogram (%llu accesses, %lli distinct %lli-byte blocks):\n",
+		profile->accesses, profile->num_blocks, block_size);
+	printf("%24s %14s\n", "distance", "accesses");
+	for (int i = 0; i <= last_bin; i++){
+		char range[48];
+		if (i <= 1){
+			sprintf(range, "%d", i);
+		}
+		else {
+			sprintf(range, "%llu-%llu", 1ULL << (i - 1), (1ULL << i) - 1);
+		}
+		printf("%24s %14llu\n", range, profile->reuse_hist[i]);
+	}
+	printf("%24s %14llu\n", "cold", profile->cold);
+
+	//a fully associative LRU cache of 2^k lines misses on cold accesses and on every distance >= 2^k,
+	//which are exactly the bins above k
+	printf("\nPredicted fully associative LRU misses:\n");
+	printf("%12s %14s %14s %12s\n", "lines", "bytes", "misses", "miss ratio");
+	for (int k = 0; k <= last_bin; k++){
+		unsigned long long misses = profile->cold;
+		for (int i = k + 1; i < PROFILE_BINS; i++){
+			misses += profile->reuse_hist[i];
+		}
+		double ratio = profile->accesses ? (double) misses / profile->accesses : 0.0;
+		printf("%12llu %14llu %14llu %12.6f\n", 1ULL << k, (1ULL << k) * (unsigned long long) block_size, misses, ratio);
+	}
+
+	printf("\nWorking set (distinct blocks per %lli-access window):\n", profile->ws_window);
+	printf("%12s %14s\n", "window", "blocks");
+	for (long long i = 0; i < profile->ws_count; i++){
+		printf("%12lli %14lli\n", i, profile->ws_curve[i]);
+	}
+
+	printf("\nWorking set histogram:\n");
+	printf("%24s %14s\n", "blocks", "windows");
+	for (int i = 0; i < PROFILE_BINS; i++){
+		if (profile->ws_hist[i] == 0){
+			continue;
+		}
+		char range[48];
+		if (i <= 1){
+			sprintf(range, "%d", i);
+		}
+		else {
+			sprintf(range, "%llu-%llu", 1ULL << (i - 1), (1ULL << i) - 1);
+		}
+		printf("%24s %14llu\n", range, profile->ws_hist[i]);
+	}
+}
+
+
+void profile_free(reuse_profile* profile){
+	free(profile->table);
+	free(profile->tree);
+	free(profile->owner);
+	free(profile->ws_curve);
+}
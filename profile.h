@@ -0,0 +1,57 @@
+/*
+ * profile.h - Reuse-distance and working-set profiler used by csim's
+ *     profiling mode (--profile).
+ */
+
+#ifndef CSIM_PROFILE_H
+#define CSIM_PROFILE_H
+
+/* Number of log2 bins in the reuse-distance and working-set histograms */
+#define PROFILE_BINS 65
+
+/* One block tracked by the profiler (open addressing hash table slot) */
+typedef struct {
+    unsigned long long block;       /* block address (address >> b) */
+    long long last_time;            /* Fenwick position of the last access, 0 = empty slot */
+    long long last_window;          /* working-set window the block was last counted in */
+} profile_entry;
+
+typedef struct {
+    /* block address -> last access table */
+    profile_entry* table;
+    long long table_size;           /* number of slots, always a power of two */
+    long long num_blocks;           /* distinct blocks seen so far */
+
+    /* Fenwick tree over access times; a 1 marks the latest access of a block */
+    int* tree;
+    long long* owner;               /* time -> table slot holding the mark, -1 if none */
+    long long capacity;
+    long long now;                  /* next free time position (1-based) */
+
+    /* reuse distance histogram: bin 0 is distance 0, bin k is [2^(k-1), 2^k - 1] */
+    unsigned long long reuse_hist[PROFILE_BINS];
+    unsigned long long cold;
+    unsigned long long accesses;
+
+    /* working-set curve over fixed windows of ws_window accesses */
+    long long ws_window;
+    long long ws_current;           /* distinct blocks in the current window */
+    long long* ws_curve;            /* distinct blocks per finished window */
+    long long ws_count;
+    long long ws_size;
+    unsigned long long ws_hist[PROFILE_BINS];
+} reuse_profile;
+
+/* Set up an empty profile that samples the working set every ws_window accesses */
+void profile_init(reuse_profile* profile, long long ws_window);
+
+/* Record one access to the given block address */
+void profile_access(reuse_profile* profile, unsigned long long block);
+
+/* Print the histograms and the predicted miss ratio curve for block_size byte blocks */
+void profile_print(reuse_profile* profile, long long block_size);
+
+/* Release all memory held by the profile */
+void profile_free(reuse_profile* profile);
+
+#endif /* CSIM_PROFILE_H */
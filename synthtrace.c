@@ -0,0 +1,556 @@
+/*
+ * synthtrace.c - Writes synthetic traces for csim, as text (the valgrind
+ *     format) or binary (see trace_binary_record in trace.h). Addresses
+ *     come from locality models: uniform random, Zipfian hot sets,
+ *     strided streams, pointer chasing through a shuffled linked list
+ *     and 5-point stencil sweeps. Each phase mixes models by weight, and
+ *     the phases take turns, so the working set can change under a
+ *     running cache. The same seed always gives the same trace.
+ */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include "trace.h"
+#include "walltime.h"
+
+/* Every model works on cache line sized objects */
+#define LINE_SIZE 64
+
+/* Size of each access */
+#define ACCESS_SIZE 8
+
+/* Most phases, and most models in one phase */
+#define MAX_PHASES 16
+#define MAX_STREAMS 64
+
+/* Defaults for the command line */
+#define DEFAULT_FOOTPRINT (16ULL << 20)
+#define DEFAULT_ALPHA 0.99
+#define DEFAULT_STRIDE 64
+
+/* Output is collected here and written in large blocks */
+#define OUTPUT_BUFFER (1 << 20)
+
+/* Longest text record: " M ffffffffffffffff,8\n" */
+#define MAX_TEXT_RECORD 32
+
+enum model_kind { MODEL_UNIFORM, MODEL_ZIPF, MODEL_STRIDE, MODEL_CHASE, MODEL_STENCIL, NUM_MODELS };
+
+static const char* model_names[NUM_MODELS] = {"uniform", "zipf", "stride", "chase", "stencil"};
+
+/* One model and where it is in its address stream; each kind has its
+   own address region, and keeps its position across phase changes */
+struct model {
+    int used;
+    unsigned long long base;
+    unsigned long long lines;       /* footprint in lines */
+    /* zipf: cumulative probability of each rank, a guide table into
+       it, and a multiplier scattering the ranks over the footprint */
+    double* cdf;
+    unsigned int* guide;
+    unsigned long long scatter;
+    /* stride */
+    unsigned long long position[MAX_STREAMS];
+    int stream;
+    /* chase: the next node of each node, one cycle through all of them */
+    unsigned int* next;
+    unsigned int node;
+    /* stencil: two square grids of doubles, read one and write the other */
+    unsigned long long side;
+    unsigned long long row, column;
+    int point;
+    int sweep;
+};
+
+/* A phase: the models it draws from, and their cumulative weights */
+struct phase {
+    int num_models;
+    int kinds[NUM_MODELS];
+    unsigned long long threshold[NUM_MODELS];
+};
+
+/* Everything a record is made from */
+struct generator {
+    unsigned long long state;       /* wyrand state */
+    struct model models[NUM_MODELS];
+    struct phase phases[MAX_PHASES];
+    int num_phases;
+    unsigned long long footprint;
+    double alpha;
+    unsigned long long stride;
+    int streams;
+    unsigned long long load_threshold, store_threshold;
+};
+
+/*
+ * next_random - wyrand, a 64 bit generator that is fast and passes
+ *     the usual statistical tests
+ */
+static inline unsigned long long next_random(struct generator* g)
+{
+    g->state += 0xa0761d6478bd642fULL;
+    unsigned __int128 product = (unsigned __int128) g->state * (g->state ^ 0xe7037ed1a0b428dbULL);
+    return (unsigned long long) (product >> 64) ^ (unsigned long long) product;
+}
+
+/*
+ * random_below - Uniform in [0, limit), by the multiply-high method
+ */
+static inline unsigned long long random_below(struct generator* g, unsigned long long limit)
+{
+    return (unsigned long long) (((unsigned __int128) next_random(g) * limit) >> 64);
+}
+
+/*
+ * parse_size - Read a count with an optional K, M or G suffix (powers
+ *     of 1024 for sizes, of 1000 for record counts)
+ */
+static int parse_size(const char* text, unsigned long long unit, unsigned long long* value)
+{
+    char* end;
+    double number = strtod(text, &end);
+    if (end == text || number < 0)
+        return 0;
+    switch (*end) {
+    case 'k': case 'K': number *= unit; end++; break;
+    case 'm': case 'M': number *= (double) unit * unit; end++; break;
+    case 'g': case 'G': number *= (double) unit * unit * unit; end++; break;
+    }
+    if (*end != '\0')
+        return 0;
+    *value = (unsigned long long) number;
+    return 1;
+}
+
+/*
+ * parse_phase - Add a phase given as "<model>[:<weight>][,...]"
+ */
+static int parse_phase(struct generator* g, const char* spec)
+{
+    char buffer[256];
+    unsigned long long weights[NUM_MODELS], total = 0;
+    struct phase* p;
+
+    if (g->num_phases == MAX_PHASES)
+        return 0;
+    p = &g->phases[g->num_phases];
+    p->num_models = 0;
+    snprintf(buffer, sizeof(buffer), "%s", spec);
+    for (char* item = strtok(buffer, ","); item != NULL; item = strtok(NULL, ",")) {
+        char* colon = strchr(item, ':');
+        long weight = 1;
+        int kind;
+        if (colon != NULL) {
+            *colon = '\0';
+            weight = atol(colon + 1);
+        }
+        for (kind = 0; kind < NUM_MODELS && strcmp(item, model_names[kind]) != 0; kind++)
+            ;
+        if (kind == NUM_MODELS || weight <= 0 || p->num_models == NUM_MODELS)
+            return 0;
+        p->kinds[p->num_models] = kind;
+        weights[p->num_models++] = weight;
+        total += weight;
+    }
+    if (p->num_models == 0)
+        return 0;
+    /* A model is picked by comparing 32 random bits with these */
+    unsigned long long sum = 0;
+    for (int i = 0; i < p->num_models; i++) {
+        sum += weights[i];
+        p->threshold[i] = (sum << 32) / total;
+    }
+    g->num_phases++;
+    return 1;
+}
+
+/*
+ * gcd - Greatest common divisor
+ */
+static unsigned long long gcd(unsigned long long a, unsigned long long b)
+{
+    while (b != 0) {
+        unsigned long long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ * setup_model - Allocate and initialize the state of one kind of model
+ */
+static int setup_model(struct generator* g, int kind)
+{
+    struct model* m = &g->models[kind];
+    unsigned long long i;
+
+    m->used = 1;
+    /* 1TB apart, so models never share lines */
+    m->base = (unsigned long long) (kind + 1) << 40;
+    m->lines = g->footprint / LINE_SIZE;
+    if (m->lines == 0)
+        m->lines = 1;
+
+    switch (kind) {
+    case MODEL_ZIPF:
+        /* The probability of rank r is proportional to 1 / (r + 1)^alpha */
+        if (m->lines > UINT32_MAX)
+            return 0;
+        m->cdf = malloc(m->lines * sizeof(double));
+        m->guide = malloc(m->lines * sizeof(unsigned int));
+        if (m->cdf == NULL || m->guide == NULL)
+            return 0;
+        double sum = 0;
+        for (i = 0; i < m->lines; i++) {
+            sum += pow((double) (i + 1), -g->alpha);
+            m->cdf[i] = sum;
+        }
+        for (i = 0; i < m->lines; i++)
+            m->cdf[i] /= sum;
+        m->cdf[m->lines - 1] = 1.0;
+        /* guide[k] is the first rank whose cdf reaches k / lines, so a
+           draw starts its search next to its answer */
+        unsigned long long rank = 0;
+        for (i = 0; i < m->lines; i++) {
+            while (m->cdf[rank] < (double) i / m->lines)
+                rank++;
+            m->guide[i] = (unsigned int) rank;
+        }
+        /* The hottest lines are spread out rather than adjacent */
+        m->scatter = (unsigned long long) (m->lines * 0.6180339887) | 1;
+        while (gcd(m->scatter, m->lines) != 1)
+            m->scatter++;
+        break;
+    case MODEL_STRIDE:
+        for (int s = 0; s < g->streams; s++)
+            m->position[s] = g->footprint / g->streams * s;
+        break;
+    case MODEL_CHASE:
+        /* Sattolo's shuffle makes a single cycle through every node */
+        if (m->lines > UINT32_MAX)
+            return 0;
+        m->next = malloc(m->lines * sizeof(unsigned int));
+        if (m->next == NULL)
+            return 0;
+        for (i = 0; i < m->lines; i++)
+            m->next[i] = (unsigned int) i;
+        for (i = m->lines - 1; i > 0; i--) {
+            unsigned long long j = random_below(g, i);
+            unsigned int t = m->next[i];
+            m->next[i] = m->next[j];
+            m->next[j] = t;
+        }
+        break;
+    case MODEL_STENCIL:
+        m->side = (unsigned long long) sqrt((double) g->footprint / (2 * sizeof(double)));
+        if (m->side < 3)
+            m->side = 3;
+        m->row = m->column = 1;
+        break;
+    }
+    return 1;
+}
+
+/*
+ * next_access - The next address of a model, and its operation when
+ *     the model decides it (0 to draw one from the mix)
+ */
+static inline unsigned long long next_access(struct generator* g, int kind, char* op)
+{
+    struct model* m = &g->models[kind];
+    unsigned long long address;
+
+    *op = 0;
+    switch (kind) {
+    case MODEL_UNIFORM:
+        return m->base + random_below(g, g->footprint / ACCESS_SIZE) * ACCESS_SIZE;
+    case MODEL_ZIPF: {
+        unsigned long long r = next_random(g);
+        double u = (r >> 11) * 0x1.0p-53;
+        unsigned long long rank = m->guide[(unsigned long long) (u * m->lines)];
+        while (m->cdf[rank] < u)
+            rank++;
+        unsigned long long line = (unsigned long long) (((unsigned __int128) rank * m->scatter) % m->lines);
+        return m->base + line * LINE_SIZE + (r & (LINE_SIZE / ACCESS_SIZE - 1)) * ACCESS_SIZE;
+    }
+    case MODEL_STRIDE: {
+        /* The streams take turns, each in its own slice of the footprint */
+        unsigned long long slice = g->footprint / g->streams;
+        int s = m->stream;
+        address = m->base + m->position[s];
+        m->position[s] += g->stride;
+        if (m->position[s] >= slice * (s + 1))
+            m->position[s] = slice * s + (m->position[s] - slice * s) % slice;
+        m->stream = s + 1 == g->streams ? 0 : s + 1;
+        return address;
+    }
+    case MODEL_CHASE:
+        /* Each node is a line; the pointer is its first word */
+        *op = 'L';
+        address = m->base + (unsigned long long) m->node * LINE_SIZE;
+        m->node = m->next[m->node];
+        return address;
+    default: {
+        /* Five loads around (row, column) of one grid, then a store to
+           the same point of the other */
+        static const int dr[5] = {0, -1, 1, 0, 0};
+        static const int dc[5] = {0, 0, 0, -1, 1};
+        unsigned long long grid = m->side * m->side * sizeof(double);
+        unsigned long long from = m->base + (m->sweep ? grid : 0);
+        unsigned long long to = m->base + (m->sweep ? 0 : grid);
+        if (m->point < 5) {
+            *op = 'L';
+            address = from + ((m->row + dr[m->point]) * m->side + m->column + dc[m->point]) * sizeof(double);
+            m->point++;
+            return address;
+        }
+        *op = 'S';
+        address = to + (m->row * m->side + m->column) * sizeof(double);
+        m->point = 0;
+        if (++m->column == m->side - 1) {
+            m->column = 1;
+            if (++m->row == m->side - 1) {
+                m->row = 1;
+                m->sweep ^= 1;
+            }
+        }
+        return address;
+    }
+    }
+}
+
+/*
+ * format_text - Write one record as " L <hex>,<size>\n", returning its length
+ */
+static inline int format_text(char* out, char op, unsigned long long address)
+{
+    static const char digits[] = "0123456789abcdef";
+    char hex[16];
+    int n = 0, length = 0;
+
+    do {
+        hex[n++] = digits[address & 15];
+        address >>= 4;
+    } while (address != 0);
+    out[length++] = ' ';
+    out[length++] = op;
+    out[length++] = ' ';
+    while (n > 0)
+        out[length++] = hex[--n];
+    out[length++] = ',';
+    out[length++] = '0' + ACCESS_SIZE;
+    out[length++] = '\n';
+    return length;
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] -n <records> [-o <file>] [-B] [-s <seed>] [-m <phase>]... [-p <records>]\n"
+           "       [-F <bytes>] [-a <alpha>] [-S <bytes>] [-k <num>] [-r <L>,<S>,<M>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h              Print this help message.\n");
+    printf("  -n <records>    Records to write; k, M and G multiply by 1000s\n");
+    printf("  -o <file>       Output file (default standard output)\n");
+    printf("  -B              Write a binary trace instead of text\n");
+    printf("  -s <seed>       Seed of the random generator (default 1)\n");
+    printf("  -m <phase>      A phase: models with weights, e.g. uniform:1,zipf:3. Models are\n"
+           "                  uniform, zipf, stride, chase and stencil. Repeat for phases that\n"
+           "                  take turns (default zipf)\n");
+    printf("  -p <records>    Records per phase (default the records split evenly)\n");
+    printf("  -F <bytes>      Footprint of each model; K, M and G multiply by 1024s (default 16M)\n");
+    printf("  -a <alpha>      Zipf exponent (default %.2f)\n", DEFAULT_ALPHA);
+    printf("  -S <bytes>      Stride of the stride model (default %d)\n", DEFAULT_STRIDE);
+    printf("  -k <num>        Interleaved streams of the stride model (default 1)\n");
+    printf("  -r <L>,<S>,<M>  Percent of loads, stores and modifies for uniform, zipf and\n"
+           "                  stride (default 70,25,5); chase only loads, stencil loads and stores\n");
+    printf("Example: %s -n 1G -B -m zipf:9,uniform:1 -m stride -p 10M -o big.trace\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    struct generator g;
+    unsigned long long records = 0, phase_records = 0, seed = 1;
+    unsigned long long i, in_phase = 0;
+    int loads = 70, stores = 25, modifies = 5;
+    int binary = 0, phase = 0;
+    char* output = NULL;
+    int c;
+
+    memset(&g, 0, sizeof(g));
+    g.footprint = DEFAULT_FOOTPRINT;
+    g.alpha = DEFAULT_ALPHA;
+    g.stride = DEFAULT_STRIDE;
+    g.streams = 1;
+
+    while ((c = getopt(argc, argv, "n:o:Bs:m:p:F:a:S:k:r:h")) != -1) {
+        switch (c) {
+        case 'n':
+            if (!parse_size(optarg, 1000, &records)) {
+                usage(argv);
+                exit(1);
+            }
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'B':
+            binary = 1;
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'm':
+            if (!parse_phase(&g, optarg)) {
+                fprintf(stderr, "Error: Bad phase %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'p':
+            if (!parse_size(optarg, 1000, &phase_records)) {
+                usage(argv);
+                exit(1);
+            }
+            break;
+        case 'F':
+            if (!parse_size(optarg, 1024, &g.footprint)) {
+                usage(argv);
+                exit(1);
+            }
+            break;
+        case 'a':
+            g.alpha = atof(optarg);
+            break;
+        case 'S':
+            g.stride = strtoull(optarg, NULL, 0);
+            break;
+        case 'k':
+            g.streams = atoi(optarg);
+            break;
+        case 'r':
+            if (sscanf(optarg, "%d,%d,%d", &loads, &stores, &modifies) != 3) {
+                usage(argv);
+                exit(1);
+            }
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (records == 0 || g.footprint < LINE_SIZE || g.stride == 0 || g.streams <= 0 || g.streams > MAX_STREAMS ||
+        loads < 0 || stores < 0 || modifies < 0 || loads + stores + modifies == 0) {
+        fprintf(stderr, "Error: Missing or bad argument\n");
+        usage(argv);
+        exit(1);
+    }
+    if (g.num_phases == 0)
+        parse_phase(&g, "zipf");
+    if (phase_records == 0)
+        phase_records = (records + g.num_phases - 1) / g.num_phases;
+
+    /* The operation mix, as thresholds on 32 random bits */
+    int total = loads + stores + modifies;
+    g.load_threshold = ((unsigned long long) loads << 32) / total;
+    g.store_threshold = ((unsigned long long) (loads + stores) << 32) / total;
+
+    g.state = seed;
+    for (int p = 0; p < g.num_phases; p++) {
+        for (int k = 0; k < g.phases[p].num_models; k++) {
+            int kind = g.phases[p].kinds[k];
+            if (!g.models[kind].used && !setup_model(&g, kind)) {
+                fprintf(stderr, "Error: Unable to set up the %s model with a %llu byte footprint\n",
+                       model_names[kind], g.footprint);
+                exit(1);
+            }
+        }
+    }
+
+    FILE* fp = output == NULL ? stdout : fopen(output, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: Unable to write %s\n", output);
+        exit(1);
+    }
+    char* buffer = malloc(OUTPUT_BUFFER + MAX_TEXT_RECORD);
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: Unable to allocate the output buffer\n");
+        exit(1);
+    }
+    size_t used = 0;
+    if (binary) {
+        memset(buffer, 0, TRACE_BINARY_HEADER);
+        memcpy(buffer, TRACE_BINARY_MAGIC, sizeof(TRACE_BINARY_MAGIC) - 1);
+        used = TRACE_BINARY_HEADER;
+    }
+
+    double start = now();
+    for (i = 0; i < records; i++) {
+        struct phase* p = &g.phases[phase];
+        int kind = p->kinds[0];
+        unsigned long long draw = next_random(&g);
+        if (p->num_models > 1) {
+            unsigned long long pick = draw >> 32;
+            int k = 0;
+            while (pick >= p->threshold[k])
+                k++;
+            kind = p->kinds[k];
+        }
+        char op;
+        unsigned long long address = next_access(&g, kind, &op);
+        if (op == 0) {
+            unsigned long long mix = draw & 0xffffffffULL;
+            op = mix < g.load_threshold ? 'L' : (mix < g.store_threshold ? 'S' : 'M');
+        }
+
+        if (binary) {
+            trace_binary_record record = {address, op, ACCESS_SIZE, TRACE_NO_CLASS, {0}};
+            memcpy(buffer + used, &record, sizeof(record));
+            used += sizeof(record);
+        } else {
+            used += format_text(buffer + used, op, address);
+        }
+        if (used >= OUTPUT_BUFFER) {
+            if (fwrite(buffer, 1, used, fp) != used) {
+                fprintf(stderr, "Error: Unable to write the trace\n");
+                exit(1);
+            }
+            used = 0;
+        }
+
+        if (++in_phase == phase_records) {
+            in_phase = 0;
+            phase = phase + 1 == g.num_phases ? 0 : phase + 1;
+        }
+    }
+    if (used > 0 && fwrite(buffer, 1, used, fp) != used) {
+        fprintf(stderr, "Error: Unable to write the trace\n");
+        exit(1);
+    }
+    if (fp != stdout)
+        fclose(fp);
+    else
+        fflush(fp);
+
+    double elapsed = now() - start;
+    fprintf(stderr, "%llu records in %.2f s, %.2f billion records/minute\n",
+            records, elapsed, elapsed > 0 ? records / elapsed * 60 * 1e-9 : 0.0);
+
+    free(buffer);
+    for (int k = 0; k < NUM_MODELS; k++) {
+        free(g.models[k].cdf);
+        free(g.models[k].guide);
+        free(g.models[k].next);
+    }
+    return 0;
+}
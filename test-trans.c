@@ -2,7 +2,14 @@
  * test-trans.c - Checks the correctness and performance of all of the
  *     student's transpose functions and records the results for their
  *     official submitted version as well.
+ *
+ *     Every registered function is evaluated on every requested matrix
+ *     size at the same time. Each evaluation runs tracegen under
+ *     valgrind with the trace coming back through a pipe, and simulates
+ *     it in memory with libcsim as it arrives, so evaluations share no
+ *     files and never write a trace to disk.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,166 +17,447 @@
 #include <string.h>
 #include <signal.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include "cachelab.h"
+#include "libcsim.h"
+#include "trace.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h> // for INT_MAX
 
-/* Maximum array dimension */
-#define MAXN 256
-
 /* The description string for the transpose_submit() function that the
    student submits for credit */
 #define SUBMIT_DESCRIPTION "Transpose submission"
 
+/* Most matrix sizes in one run */
+#define MAX_SIZES 16
+
+/* Accesses handed to libcsim at a time */
+#define TRACE_BATCH 4096
+
+/* Bytes read from a pipe at a time */
+#define READ_CHUNK 65536
+
+/* Cache levels simulated at once: the scoring cache and up to two below it */
+#define MAX_LEVELS 3
+
 /* External function defined in trans.c */
 extern void registerFunctions();
 
 /* External variables defined in cachelab-tools.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
-extern int func_counter; 
+extern int func_counter;
+
+/* Globals set on the command line: each -M and -N pair is one size */
+static int sizes_M[MAX_SIZES];
+static int sizes_N[MAX_SIZES];
+static int num_M = 0;
+static int num_N = 0;
+
+/* Alignment and padding of the matrices, passed on to tracegen */
+static long alignment = 4096;
+static long padding = 0;
 
-/* Globals set on the command line */
-static int M = 0;
-static int N = 0;
+/* Cache the functions are scored on, the 1KB direct mapped cache by default;
+   cache_sets, when given, is its set count instead of 1 << cache_s */
+static unsigned int cache_s = 5;
+static unsigned int cache_E = 1;
+static unsigned int cache_b = 5;
+static long cache_sets = 0;
 
-/* The correctness and performance for the submitted transpose function */
+/* Every cache simulated: levels[0] is the scoring cache, and each level
+   below it sees only the misses of the level above */
+static csim_config levels[MAX_LEVELS];
+static int num_levels = 1;
+
+/* Only evaluate this function, -1 for all of them */
+static int only_func = -1;
+
+/* Simulate only the loads: stores are left out and a modify is its load */
+static int loads_only = 0;
+
+/* Evaluations run at once, one per processor by default */
+static int max_jobs = 0;
+
+/* The correctness and performance for the submitted transpose function,
+   for each size */
 struct results {
     int funcid;
     int correct;
     int misses;
 };
-static struct results results = {-1, 0, INT_MAX};
+static struct results results[MAX_SIZES];
+
+/* One evaluation: one function on one matrix size */
+struct evaluation {
+    int func;
+    int size;
+    int flag;           /* tracegen's exit status, 0 when the transpose was correct */
+    int marker_found;   /* the trace reached the start marker */
+    unsigned long long hits[MAX_LEVELS];
+    unsigned long long misses[MAX_LEVELS];
+    unsigned long long evictions[MAX_LEVELS];
+};
+static struct evaluation* evaluations;
+static int num_evaluations = 0;
+static int next_evaluation = 0;
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The part of a trace read but not simulated yet */
+struct trace_state {
+    char* data;
+    size_t length;
+    size_t capacity;
+    char markers[128];  /* tracegen's marker window and matrix ranges, as it printed them */
+    size_t markers_length;
+    int filtering;      /* the filter is set up from the markers */
+    trace_filter filter;
+    csim_handle* caches[MAX_LEVELS];
+    addr_t addresses[TRACE_BATCH];
+    uint8_t ops[TRACE_BATCH];
+    size_t batched;
+    addr_t missed[MAX_LEVELS - 1][TRACE_BATCH];    /* what each level hands the next */
+};
 
-/* 
- * eval_perf - Evaluate the performance of the registered transpose functions
+/*
+ * simulate_batch - Run the batched accesses through the scoring cache,
+ *     and its misses, as loads, through each level below it
  */
-void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+static void simulate_batch(struct trace_state* state)
 {
-    int i,flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[255];
-    char filename[128];
-
-    registerFunctions(); 
+    const addr_t* addresses = state->addresses;
+    const uint8_t* ops = state->ops;
+    size_t n = state->batched;
+    int level;
+
+    for (level = 0; level < num_levels - 1; level++) {
+        n = csim_access_batch_misses(state->caches[level], addresses, ops, n, state->missed[level]);
+        addresses = state->missed[level];
+        ops = NULL;
+    }
+    csim_access_batch(state->caches[level], addresses, ops, n);
+    state->batched = 0;
+}
 
-    /* Open the complete trace file */
-    FILE* full_trace_fp;  
-    FILE* part_trace_fp; 
+/*
+ * simulate_lines - Feed the complete lines at the front of the buffer
+ *     through the marker and address filters into the cache, and keep
+ *     the incomplete last line for the next read
+ */
+static void simulate_lines(struct trace_state* state)
+{
+    char* line = state->data;
+    char* end = state->data + state->length;
+    char* newline;
+
+    while (!state->filter.finished && (newline = memchr(line, '\n', end - line)) != NULL) {
+        char op;
+        addr_t address;
+        int size, class_id;
+        const char* record = line;
+        line = newline + 1;
+
+        if (!trace_parse_line(record, &op, &address, &size, &class_id))
+            continue;
+        if (!trace_filter_accept(&state->filter, op, address))
+            continue;
+        if (loads_only) {
+            if (op == 'S')
+                continue;
+            op = 'L';
+        }
+        state->addresses[state->batched] = address;
+        state->ops[state->batched] = (uint8_t) op;
+        if (++state->batched == TRACE_BATCH)
+            simulate_batch(state);
+    }
 
-    /* Evaluate the performance of each registered transpose function */
+    /* Past the end marker nothing else is needed */
+    if (state->filter.finished) {
+        state->length = 0;
+        return;
+    }
+    state->length = end - line;
+    memmove(state->data, line, state->length);
+}
 
-    for (i=0; i<func_counter; i++) {
-        if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0 )
-            results.funcid = i; /* remember which function is the submission */
+/*
+ * read_trace - Take what the pipe has, and simulate it once the marker
+ *     addresses are known. Returns 0 at the end of the pipe.
+ */
+static int read_trace(int fd, struct trace_state* state)
+{
+    if (state->capacity - state->length < READ_CHUNK) {
+        state->capacity = state->capacity * 2 + READ_CHUNK;
+        state->data = realloc(state->data, state->capacity);
+        assert(state->data);
+    }
+    ssize_t got = read(fd, state->data + state->length, READ_CHUNK);
+    if (got <= 0)
+        return 0;
+    state->length += got;
+    if (state->filtering)
+        simulate_lines(state);
+    return 1;
+}
 
+/*
+ * read_markers - Take tracegen's stderr; once its first line is in,
+ *     set the filter up and simulate what was held back. Returns 0 at
+ *     the end of the pipe.
+ */
+static int read_markers(int fd, struct trace_state* state)
+{
+    char chunk[256];
+    ssize_t got = read(fd, chunk, sizeof(chunk));
+    if (got <= 0)
+        return 0;
+    if (!state->filtering) {
+        size_t room = sizeof(state->markers) - 1 - state->markers_length;
+        size_t n = (size_t) got < room ? (size_t) got : room;
+        memcpy(state->markers + state->markers_length, chunk, n);
+        state->markers_length += n;
+        state->markers[state->markers_length] = '\0';
+
+        char* newline = strchr(state->markers, '\n');
+        if (newline != NULL) {
+            char* rest;
+            char spec[32];
+            *newline = '\0';
+            char* window = strtok_r(state->markers, " ", &rest);
+            char* matrix_a = strtok_r(NULL, " ", &rest);
+            char* matrix_b = strtok_r(NULL, " ", &rest);
+            /* Only the two matrices, wherever the heap put them, and the
+               marker stores that open and close the window, which the
+               low 32-bit filter test-trans used to give csim kept too */
+            if (window != NULL && matrix_a != NULL && matrix_b != NULL &&
+                trace_filter_set_markers(&state->filter, window) &&
+                trace_filter_add_range(&state->filter, matrix_a, true) &&
+                trace_filter_add_range(&state->filter, matrix_b, true)) {
+                sprintf(spec, "%llx", state->filter.marker_start);
+                trace_filter_add_range(&state->filter, spec, true);
+                sprintf(spec, "%llx", state->filter.marker_end);
+                trace_filter_add_range(&state->filter, spec, true);
+                state->filtering = 1;
+                simulate_lines(state);
+            }
+        }
+    }
+    return 1;
+}
 
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
+/*
+ * evaluate - Trace one function on one size and simulate the trace
+ */
+static void evaluate(struct evaluation* e)
+{
+    int trace_pipe[2], marker_pipe[2];
+    char m[16], n[16], f[16], a[32], p[32];
+    int level;
+    struct trace_state* state = calloc(1, sizeof(struct trace_state));
+    assert(state);
+
+    trace_filter_init(&state->filter);
+    for (level = 0; level < num_levels; level++) {
+        state->caches[level] = csim_create(&levels[level]);
+        assert(state->caches[level]);
+    }
 
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-        flag=WEXITSTATUS(system(cmd));
-        if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
+    /* Close-on-exec keeps each pipe out of the other evaluations' children */
+    if (pipe2(trace_pipe, O_CLOEXEC) != 0 || pipe2(marker_pipe, O_CLOEXEC) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    sprintf(m, "%d", sizes_M[e->size]);
+    sprintf(n, "%d", sizes_N[e->size]);
+    sprintf(f, "%d", e->func);
+    sprintf(a, "%ld", alignment);
+    sprintf(p, "%ld", padding);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        /* Use valgrind to generate the trace, on the pipe instead of trace.tmp */
+        dup2(trace_pipe[1], STDOUT_FILENO);
+        dup2(marker_pipe[1], STDERR_FILENO);
+        execlp("valgrind", "valgrind", "--tool=lackey", "--trace-mem=yes", "--log-fd=1", "-v",
+               "./tracegen", "-M", m, "-N", n, "-F", f, "-a", a, "-p", p, "-m", (char*) NULL);
+        _exit(127); /* reported as valgrind missing */
+    }
+    close(trace_pipe[1]);
+    close(marker_pipe[1]);
+
+    /* Read both pipes until valgrind closes them */
+    struct pollfd fds[2] = {{trace_pipe[0], POLLIN, 0}, {marker_pipe[0], POLLIN, 0}};
+    int open_pipes = 2;
+    while (open_pipes > 0) {
+        if (poll(fds, 2, -1) < 0)
             continue;
+        if (fds[0].revents && !read_trace(fds[0].fd, state)) {
+            fds[0].fd = -1;
+            open_pipes--;
+        }
+        if (fds[1].revents && !read_markers(fds[1].fd, state)) {
+            fds[1].fd = -1;
+            open_pipes--;
         }
+    }
+    close(trace_pipe[0]);
+    close(marker_pipe[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    e->flag = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+
+    if (state->batched > 0)
+        simulate_batch(state);
+    e->marker_found = state->filter.use_markers && state->filter.marker_state != MARKERS_BEFORE;
+    for (level = 0; level < num_levels; level++) {
+        csim_counts counts = csim_stats(state->caches[level]);
+        e->hits[level] = counts.hits;
+        e->misses[level] = counts.misses;
+        e->evictions[level] = counts.evictions;
+        csim_destroy(state->caches[level]);
+    }
+    free(state->data);
+    free(state);
+}
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
+/*
+ * evaluation_worker - Take evaluations off the list until none are left
+ */
+static void* evaluation_worker(void* unused)
+{
+    for (;;) {
+        pthread_mutex_lock(&next_lock);
+        int i = next_evaluation++;
+        pthread_mutex_unlock(&next_lock);
+        if (i >= num_evaluations)
+            return NULL;
+        evaluate(&evaluations[i]);
+    }
+}
 
+/*
+ * eval_perf - Evaluate the performance of the registered transpose functions
+ */
+void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i, j, size, num_threads, num_funcs;
+    pthread_t threads[MAX_TRANS_FUNCS * MAX_SIZES];
 
-        func_list[i].correct=1;
+    registerFunctions();
+    if (only_func >= func_counter) {
+        printf("Error: There are only %d registered functions\n", func_counter);
+        exit(1);
+    }
 
-        /* Save the correctness of the transpose submission */
-        if (results.funcid == i ) {
-            results.correct = 1;
+    for (size = 0; size < num_M; size++)
+        results[size] = (struct results) {-1, 0, INT_MAX};
+    for (i = 0; i < func_counter; i++)
+        if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0)
+            for (size = 0; size < num_M; size++)
+                results[size].funcid = i; /* remember which function is the submission */
+
+    /* Every function (or the one selected) on every size, all at once up to max_jobs */
+    num_funcs = only_func >= 0 ? 1 : func_counter;
+    num_evaluations = num_funcs * num_M;
+    evaluations = calloc(num_evaluations, sizeof(struct evaluation));
+    assert(evaluations);
+    for (size = 0; size < num_M; size++) {
+        for (j = 0; j < num_funcs; j++) {
+            evaluations[size * num_funcs + j].func = only_func >= 0 ? only_func : j;
+            evaluations[size * num_funcs + j].size = size;
         }
+    }
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-    
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
+    if (cache_sets > 0)
+        printf("Evaluating %d functions on %d sizes (sets=%ld, E=%d, b=%d)\n", num_funcs, num_M, cache_sets, E, b);
+    else
+        printf("Evaluating %d functions on %d sizes (s=%d, E=%d, b=%d)\n", num_funcs, num_M, s, E, b);
+    for (j = 1; j < num_levels; j++)
+        printf("  then level %d: sets=%ld, E=%d, b=%d, fed the misses of level %d\n",
+               j + 1, levels[j].sets, levels[j].E, levels[j].b, j);
+    fflush(stdout);
+    num_threads = max_jobs < num_evaluations ? max_jobs : num_evaluations;
+    for (i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, evaluation_worker, NULL);
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    /* Collect the results into one table */
+    for (size = 0; size < num_M; size++) {
+        int M = sizes_M[size], N = sizes_N[size];
+        printf("\n%dx%d\n", M, N);
+        for (j = 0; j < num_funcs; j++) {
+            struct evaluation* e = &evaluations[size * num_funcs + j];
+            i = e->func;
+            if (e->flag == 127) {
+                printf("func %u (%s): could not run valgrind\n", i, func_list[i].description);
+                continue;
+            }
+            if (e->flag != 0) {
+                printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\n",
+                       e->flag - 1, M, N, i);
+                continue;
+            }
+            if (!e->marker_found) {
+                printf("func %u (%s): no trace, is valgrind installed?\n", i, func_list[i].description);
+                continue;
+            }
+            func_list[i].correct = 1;
+            func_list[i].num_hits = e->hits[0];
+            func_list[i].num_misses = e->misses[0];
+            func_list[i].num_evictions = e->evictions[0];
+            printf("func %u (%s): hits:%llu, misses:%llu, evictions:%llu\n",
+                   i, func_list[i].description, e->hits[0], e->misses[0], e->evictions[0]);
+            for (int level = 1; level < num_levels; level++)
+                printf("func %u (%s) level %d: hits:%llu, misses:%llu, evictions:%llu\n",
+                       i, func_list[i].description, level + 1, e->hits[level], e->misses[level],
+                       e->evictions[level]);
+
+            /* If it is transpose_submit(), record its correctness and number of misses */
+            if (results[size].funcid == i) {
+                results[size].correct = 1;
+                results[size].misses = e->misses[0];
             }
-        }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
-        func_list[i].num_hits = hits;
-        func_list[i].num_misses = misses;
-        func_list[i].num_evictions = evictions;
-        printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
-               i, func_list[i].description, hits, misses, evictions);
-    
-        /* If it is transpose_submit(), record number of misses */
-        if (results.funcid == i) {
-            results.misses = misses;
         }
     }
-  
+    free(evaluations);
 }
 
 /*
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-h] -M <rows> -N <cols> [-M <rows> -N <cols> ...]\n", argv[0]);
+    printf("       [-s <num> | -S <sets>] [-E <num> -b <num>] [-L <sets>,<E>,<b> ...]\n");
+    printf("       [-F <num>] [-l] [-a <bytes>] [-p <bytes>] [-j <num>]\n");
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
-    printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
-    printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
-    printf("Example: %s -M 8 -N 8\n", argv[0]);       
+    printf("  -M <rows>   Number of matrix rows\n");
+    printf("  -N <cols>   Number of  matrix columns\n");
+    printf("              Repeat -M and -N to evaluate several sizes (max %d).\n", MAX_SIZES);
+    printf("  -s <num>    Set index bits of the scoring cache (default 5)\n");
+    printf("  -E <num>    Lines per set of the scoring cache (default 1)\n");
+    printf("  -S <sets>   Sets of the scoring cache instead of -s, need not be a power of two\n");
+    printf("  -b <num>    Block offset bits of the scoring cache (default 5)\n");
+    printf("  -L <sets>,<E>,<b>  A cache level below, fed the misses of the level above\n");
+    printf("              (repeat for up to %d levels)\n", MAX_LEVELS - 1);
+    printf("  -F <num>    Only evaluate this registered function\n");
+    printf("  -l          Simulate loads only (a modify counts as its load)\n");
+    printf("  -a <bytes>  Alignment of the matrices, a power of two (default 4096)\n");
+    printf("  -p <bytes>  Extra distance from the end of A to B (default 0)\n");
+    printf("  -j <num>    Evaluations run at once (default one per processor)\n");
+    printf("Example: %s -M 8 -N 8\n", argv[0]);
+    printf("         %s -M 61 -N 67 -s 6 -E 4 -b 6\n", argv[0]);
+    printf("         %s -M 32 -N 32 -M 64 -N 64 -M 61 -N 67\n", argv[0]);
+    printf("         %s -M 64 -N 64 -F 1 -l -S 64 -E 8 -b 6 -L 12288,16,6\n", argv[0]);
 }
 
 /*
@@ -192,20 +480,69 @@ void sigalrm_handler(int signum){
     exit(1);
 }
 
-/* 
+/*
  * main - Main routine
  */
 int main(int argc, char* argv[])
 {
     char c;
+    int size;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:s:S:E:b:L:F:la:p:j:h")) != -1) {
         switch(c) {
         case 'M':
-            M = atoi(optarg);
+            if (num_M == MAX_SIZES) {
+                printf("Error: More than %d sizes\n", MAX_SIZES);
+                exit(1);
+            }
+            sizes_M[num_M++] = atoi(optarg);
             break;
         case 'N':
-            N = atoi(optarg);
+            if (num_N == MAX_SIZES) {
+                printf("Error: More than %d sizes\n", MAX_SIZES);
+                exit(1);
+            }
+            sizes_N[num_N++] = atoi(optarg);
+            break;
+        case 's':
+            cache_s = atoi(optarg);
+            break;
+        case 'S':
+            cache_sets = atol(optarg);
+            break;
+        case 'E':
+            cache_E = atoi(optarg);
+            break;
+        case 'b':
+            cache_b = atoi(optarg);
+            break;
+        case 'L':
+            if (num_levels == MAX_LEVELS) {
+                printf("Error: More than %d levels below the scoring cache\n", MAX_LEVELS - 1);
+                exit(1);
+            }
+            levels[num_levels] = (csim_config) {0, 0, 0, 0};
+            if (sscanf(optarg, "%ld,%d,%d", &levels[num_levels].sets, &levels[num_levels].E,
+                       &levels[num_levels].b) != 3 || levels[num_levels].sets <= 0) {
+                printf("Error: Bad level %s, expected <sets>,<E>,<b>\n", optarg);
+                exit(1);
+            }
+            num_levels++;
+            break;
+        case 'F':
+            only_func = atoi(optarg);
+            break;
+        case 'l':
+            loads_only = 1;
+            break;
+        case 'a':
+            alignment = atol(optarg);
+            break;
+        case 'p':
+            padding = atol(optarg);
+            break;
+        case 'j':
+            max_jobs = atoi(optarg);
             break;
         case 'h':
             usage(argv);
@@ -215,18 +552,56 @@ int main(int argc, char* argv[])
             exit(1);
         }
     }
-  
-    if (M == 0 || N == 0) {
+
+    if (num_M == 0 || num_M != num_N) {
         printf("Error: Missing required argument\n");
         usage(argv);
         exit(1);
     }
 
-    if (M > MAXN || N > MAXN) {
-        printf("Error: M or N exceeds %d\n", MAXN);
+    for (size = 0; size < num_M; size++) {
+        if (sizes_M[size] <= 0 || sizes_N[size] <= 0) {
+            printf("Error: Invalid matrix size, alignment or padding\n");
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (padding < 0 || alignment < (long) sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        printf("Error: Invalid matrix size, alignment or padding\n");
+        usage(argv);
+        exit(1);
+    }
+
+    /* -S sets the scoring cache's set count directly, with s the bits needed to count them */
+    if (cache_sets > 0)
+        for (cache_s = 0; (1L << cache_s) < cache_sets && cache_s < 31; cache_s++)
+            ;
+    if ((cache_s == 0 && cache_sets != 1) || cache_sets < 0 || cache_E == 0 || cache_b == 0 ||
+        cache_s + cache_b > 32) {
+        printf("Error: Invalid cache geometry\n");
         usage(argv);
         exit(1);
     }
+    levels[0] = (csim_config) {cache_s, cache_E, cache_b, cache_sets};
+    for (size = 0; size < num_levels; size++) {
+        csim_handle* check = csim_create(&levels[size]);
+        if (check == NULL) {
+            printf("Error: Invalid cache geometry\n");
+            usage(argv);
+            exit(1);
+        }
+        csim_destroy(check);
+    }
+    if (only_func < -1) {
+        printf("Error: Invalid function number\n");
+        usage(argv);
+        exit(1);
+    }
+
+    if (max_jobs <= 0)
+        max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_jobs <= 0)
+        max_jobs = 1;
 
     /* Install SIGSEGV and SIGALRM handlers */
     if (signal(SIGSEGV, sigsegv_handler) == SIG_ERR) {
@@ -239,23 +614,29 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
-    /* Time out and give up after a while */
-    alarm(120);
+    /* Time out and give up after a while: as long per matrix size as
+       one test-trans run per size used to get */
+    alarm(120 * num_M);
 
     /* Check the performance of the student's transpose function */
-    eval_perf(5, 1, 5);
-  
-    /* Emit the results for this particular test */
-    if (results.funcid == -1) {
-        printf("\nError: We could not find your transpose_submit() function\n");
-        printf("Error: Please ensure that description field is exactly \"%s\"\n", 
-               SUBMIT_DESCRIPTION);
-        printf("\nTEST_TRANS_RESULTS=0:0\n");
-    }
-    else {
-        printf("\nSummary for official submission (func %d): correctness=%d misses=%d\n",
-               results.funcid, results.correct, results.misses);
-        printf("\nTEST_TRANS_RESULTS=%d:%d\n", results.correct, results.misses);
+    eval_perf(cache_s, cache_E, cache_b);
+
+    /* Emit the results for each size, in the order they were given; a
+       run of one other function has no submission to report */
+    if (only_func >= 0 && results[0].funcid != only_func)
+        return 0;
+    for (size = 0; size < num_M; size++) {
+        if (results[size].funcid == -1) {
+            printf("\nError: We could not find your transpose_submit() function\n");
+            printf("Error: Please ensure that description field is exactly \"%s\"\n",
+                   SUBMIT_DESCRIPTION);
+            printf("\nTEST_TRANS_RESULTS=0:0\n");
+        }
+        else {
+            printf("\nSummary for official submission (func %d, %dx%d): correctness=%d misses=%d\n",
+                   results[size].funcid, sizes_M[size], sizes_N[size], results[size].correct, results[size].misses);
+            printf("\nTEST_TRANS_RESULTS=%d:%d\n", results[size].correct, results[size].misses);
+        }
     }
     return 0;
 }
@@ -0,0 +1,154 @@
+/*
+* Title: timing.c
+*
+* Purpose: timing.c turns the level each access was served from into an estimated cycle count. The core is modeled as
+*	blocking and in-order: every access waits for its data before the next one starts, so the cycle count is the sum of
+*	the access latencies. Memory accesses also go through a single channel with a fixed bandwidth; a demand miss that finds
+*	the channel busy (with a prefetch fill, for example) waits for it. The result is the total cycle estimate, the average
+*	memory access time, and for each operation type (L, S, M) how many cycles went to each level and to translation.
+*/
+
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//defaults roughly matching a current desktop core
+#define DEFAULT_L1_LATENCY 4
+#define DEFAULT_VICTIM_LATENCY 6
+#define DEFAULT_L2_LATENCY 14
+#define DEFAULT_MEMORY_LATENCY 200
+#define DEFAULT_TLB2_LATENCY 7
+
+
+bool timing_init(timing_model* model, const char* spec, double bandwidth, int block_size){
+	memset(model, 0, sizeof(timing_model));
+	model->latency[SERVED_L1] = DEFAULT_L1_LATENCY;
+	model->latency[SERVED_VICTIM] = DEFAULT_VICTIM_LATENCY;
+	model->latency[SERVED_L2] = DEFAULT_L2_LATENCY;
+	model->latency[SERVED_MEMORY] = DEFAULT_MEMORY_LATENCY;
+	model->tlb2_latency = DEFAULT_TLB2_LATENCY;
+	model->bandwidth = bandwidth;
+	model->block_size = block_size;
+	if (bandwidth <= 0){
+		return false;
+	}
+
+	//"name=cycles" pairs, comma separated
+	while (spec != NULL && *spec != '\0'){
+		char name[16];
+		int cycles;
+		int consumed;
+		if (sscanf(spec, "%15[a-z0-9]=%d%n", name, &cycles, &consumed) != 2 || cycles < 0){
+			return false;
+		}
+		if (strcmp(name, "l1") == 0){
+			model->latency[SERVED_L1] = cycles;
+		}
+		else if (strcmp(name, "victim") == 0){
+			model->latency[SERVED_VICTIM] = cycles;
+		}
+		else if (strcmp(name, "l2") == 0){
+			model->latency[SERVED_L2] = cycles;
+		}
+		else if (strcmp(name, "mem") == 0){
+			model->latency[SERVED_MEMORY] = cycles;
+		}
+		else if (strcmp(name, "tlb2") == 0){
+			model->tlb2_latency = cycles;
+		}
+		else {
+			return false;
+		}
+		spec += consumed;
+		if (*spec == ','){
+			spec++;
+		}
+		else if (*spec != '\0'){
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/* Function to move one block over the memory channel, starting no earlier than the given cycle.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	timing_model* model --> the timing model
+*
+*	double request --> cycle the transfer is requested at
+*
+*	=======
+*	Returns
+*	=======
+*
+*	double, cycle the transfer starts at (after waiting for the channel)
+*/
+static double use_channel(timing_model* model, double request){
+	double start = request > model->channel_free ? request : model->channel_free;
+	model->channel_free = start + model->block_size / model->bandwidth;
+	return start;
+}
+
+
+void timing_access(timing_model* model, int op, int served, bool translation){
+	double latency = model->latency[served];
+	if (served == SERVED_MEMORY){
+		//queue behind earlier transfers, then wait for DRAM and for the block to stream in
+		double start = use_channel(model, model->cycle);
+		latency = (start - model->cycle) + model->latency[SERVED_MEMORY] + model->block_size / model->bandwidth;
+	}
+	model->cycle += latency;
+	model->cycles[op] += latency;
+	if (translation){
+		model->translation_cycles[op] += latency;
+	}
+	else {
+		model->accesses[op]++;
+		model->served_cycles[op][served] += latency;
+	}
+}
+
+
+void timing_tlb2_hit(timing_model* model, int op){
+	model->cycle += model->tlb2_latency;
+	model->cycles[op] += model->tlb2_latency;
+	model->translation_cycles[op] += model->tlb2_latency;
+}
+
+
+void timing_prefetch(timing_model* model){
+	//prefetches do not stall the core, they only take channel time away from demand misses
+	use_channel(model, model->cycle);
+}
+
+
+void timing_print(timing_model* model){
+	static const char op_names[OP_TYPES] = {'L', 'S', 'M'};
+	unsigned long long total_accesses = 0;
+	double total_cycles = 0;
+	for (int op = 0; op < OP_TYPES; op++){
+		total_accesses += model->accesses[op];
+		total_cycles += model->cycles[op];
+	}
+
+	printf("cycles:%.0f AMAT:%.2f\n", total_cycles, total_accesses ? total_cycles / total_accesses : 0.0);
+	printf("%3s %12s %14s %8s %14s %12s %12s %12s %14s %12s\n",
+		   "op", "accesses", "cycles", "AMAT", "stalls", "l1", "victim", "l2", "memory", "translation");
+	for (int op = 0; op < OP_TYPES; op++){
+		if (model->accesses[op] == 0){
+			continue;
+		}
+		//anything beyond an L1 hit per access is a stall
+		double stalls = model->cycles[op] - (double) model->accesses[op] * model->latency[SERVED_L1];
+		printf("%3c %12llu %14.0f %8.2f %14.0f %12.0f %12.0f %12.0f %14.0f %12.0f\n", op_names[op], model->accesses[op],
+			   model->cycles[op], model->cycles[op] / model->accesses[op], stalls,
+			   model->served_cycles[op][SERVED_L1], model->served_cycles[op][SERVED_VICTIM],
+			   model->served_cycles[op][SERVED_L2], model->served_cycles[op][SERVED_MEMORY],
+			   model->translation_cycles[op]);
+	}
+}
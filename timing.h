@@ -0,0 +1,67 @@
+/*
+ * timing.h - Latency and bandwidth model used by csim (--timing).
+ *     csim tells the model where each access was served from; the
+ *     model turns that into cycles, assuming a blocking in-order core
+ *     and one memory channel shared with prefetch traffic.
+ */
+
+#ifndef CSIM_TIMING_H
+#define CSIM_TIMING_H
+
+#include <stdbool.h>
+
+/* Where an access was served from */
+#define SERVED_L1     0
+#define SERVED_VICTIM 1
+#define SERVED_L2     2
+#define SERVED_MEMORY 3
+#define SERVED_LEVELS 4
+
+/* Operation types of the trace, in the order they are reported */
+#define OP_LOAD   0
+#define OP_STORE  1
+#define OP_MODIFY 2
+#define OP_TYPES  3
+
+typedef struct {
+    /* configuration, in cycles and bytes per cycle */
+    int latency[SERVED_LEVELS];     /* hit latency of each level, memory is the DRAM access latency */
+    int tlb2_latency;               /* extra cycles for a translation found in the L2 TLB */
+    double bandwidth;               /* memory bytes transferred per cycle */
+    int block_size;                 /* bytes moved per memory access */
+
+    /* state */
+    double cycle;                   /* current cycle of the in-order core */
+    double channel_free;            /* cycle the memory channel finishes its last transfer */
+
+    /* per operation type results */
+    unsigned long long accesses[OP_TYPES];
+    double cycles[OP_TYPES];
+    double served_cycles[OP_TYPES][SERVED_LEVELS];
+    double translation_cycles[OP_TYPES];
+} timing_model;
+
+/*
+ * timing_init - Set defaults, then apply "name=cycles" overrides from a
+ *     comma separated list (l1, victim, l2, mem, tlb2; spec may be NULL).
+ *     Returns false on an unknown name or a bad value.
+ */
+bool timing_init(timing_model* model, const char* spec, double bandwidth, int block_size);
+
+/*
+ * timing_access - Charge one access of the given operation type served
+ *     from the given level. Page table reads pass translation = true so
+ *     their cycles are reported as translation cost of the operation.
+ */
+void timing_access(timing_model* model, int op, int served, bool translation);
+
+/* timing_tlb2_hit - Charge the L2 TLB latency to an operation */
+void timing_tlb2_hit(timing_model* model, int op);
+
+/* timing_prefetch - Occupy the memory channel with one prefetch fill */
+void timing_prefetch(timing_model* model);
+
+/* timing_print - Print total cycles, AMAT and the per operation breakdown */
+void timing_print(timing_model* model);
+
+#endif /* CSIM_TIMING_H */
@@ -0,0 +1,216 @@
+/*
+* Title: tlb.c
+*
+* Purpose: tlb.c models the address translation hardware in front of the data cache: up to two set associative LRU TLB
+*	levels and an x86-64 page table walker. Pages are 4KB (4 level walk), 2MB (3 levels) or 1GB (2 levels). The walker
+*	reads one page table entry per level; the page tables are laid out as if each level were one linear array indexed by
+*	the virtual address bits above that level's shift, placed in the kernel half of the address space so they never
+*	collide with the user addresses lackey records. csim runs those reads through the cache, so page walks compete with
+*	the program's own data for cache lines the way they do on real hardware.
+*/
+
+#include "tlb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//start of the page table region, one 1TB slice per page table level
+#define PAGE_TABLE_BASE 0xFFFF800000000000ULL
+
+//lackey traces use 48 bit virtual addresses
+#define VIRTUAL_ADDRESS_MASK ((1ULL << 48) - 1)
+
+
+/* Function to allocate one TLB level.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	tlb_level* level --> the level to set up
+*
+*	int entries --> total number of entries
+*
+*	int ways --> entries per set, has to divide entries
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, false if the geometry is not valid
+*/
+static bool init_level(tlb_level* level, int entries, int ways){
+	if (entries <= 0 || ways <= 0 || entries % ways != 0){
+		return false;
+	}
+	level->entries = entries;
+	level->ways = ways;
+	level->sets = entries / ways;
+	level->pages = (unsigned long long*) calloc(entries, sizeof(unsigned long long));
+	level->last_use = (unsigned long long*) calloc(entries, sizeof(unsigned long long));
+	level->hits = 0;
+	level->misses = 0;
+	return true;
+}
+
+
+bool tlb_init(tlb* t, const char* levels, const char* page_size){
+	memset(t, 0, sizeof(tlb));
+
+	if (strcmp(page_size, "4k") == 0 || strcmp(page_size, "4K") == 0){
+		t->page_shift = 12;
+		t->walk_levels = 4;
+	}
+	else if (strcmp(page_size, "2m") == 0 || strcmp(page_size, "2M") == 0){
+		t->page_shift = 21;
+		t->walk_levels = 3;
+	}
+	else if (strcmp(page_size, "1g") == 0 || strcmp(page_size, "1G") == 0){
+		t->page_shift = 30;
+		t->walk_levels = 2;
+	}
+	else {
+		return false;
+	}
+
+	//"<entries>:<ways>" for each level, comma separated
+	while (*levels != '\0'){
+		int entries;
+		int ways;
+		int consumed;
+		if (t->num_levels == TLB_MAX_LEVELS ||
+			sscanf(levels, "%d:%d%n", &entries, &ways, &consumed) != 2 ||
+			!init_level(&t->levels[t->num_levels], entries, ways)){
+			tlb_free(t);
+			return false;
+		}
+		t->num_levels++;
+		levels += consumed;
+		if (*levels == ','){
+			levels++;
+		}
+		else if (*levels != '\0'){
+			tlb_free(t);
+			return false;
+		}
+	}
+	return t->num_levels > 0;
+}
+
+
+/* Function to look a page up in one TLB level.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	tlb_level* level --> the level to search
+*
+*	unsigned long long page --> virtual page number
+*
+*	unsigned long long clock --> current time, for LRU
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, true on a hit
+*/
+static bool lookup_level(tlb_level* level, unsigned long long page, unsigned long long clock){
+	int first = (int) (page % level->sets) * level->ways;
+	for (int i = first; i < first + level->ways; i++){
+		if (level->pages[i] == page + 1){
+			level->last_use[i] = clock;
+			level->hits++;
+			return true;
+		}
+	}
+	level->misses++;
+	return false;
+}
+
+
+/* Function to put a page into one TLB level, replacing an empty or the least recently used entry of its set.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	tlb_level* level --> the level to fill
+*
+*	unsigned long long page --> virtual page number
+*
+*	unsigned long long clock --> current time, for LRU
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void fill_level(tlb_level* level, unsigned long long page, unsigned long long clock){
+	int first = (int) (page % level->sets) * level->ways;
+	int replace = first;
+	for (int i = first; i < first + level->ways; i++){
+		if (level->pages[i] == 0){
+			replace = i;
+			break;
+		}
+		if (level->last_use[i] < level->last_use[replace]){
+			replace = i;
+		}
+	}
+	level->pages[replace] = page + 1;
+	level->last_use[replace] = clock;
+}
+
+
+int tlb_translate(tlb* t, unsigned long long address, unsigned long long* pte_addresses){
+	unsigned long long virtual_address = address & VIRTUAL_ADDRESS_MASK;
+	unsigned long long page = virtual_address >> t->page_shift;
+	t->clock++;
+
+	//search the levels in order; a hit refills the levels above it
+	for (int i = 0; i < t->num_levels; i++){
+		if (lookup_level(&t->levels[i], page, t->clock)){
+			for (int j = 0; j < i; j++){
+				fill_level(&t->levels[j], page, t->clock);
+			}
+			t->last_hit_level = i;
+			return 0;
+		}
+	}
+
+	//missed everywhere: walk from the root (bits 47-39) down to the level that maps the page
+	t->walks++;
+	t->last_hit_level = -1;
+	for (int k = 0; k < t->walk_levels; k++){
+		int shift = 39 - 9 * k;
+		pte_addresses[k] = PAGE_TABLE_BASE + ((unsigned long long) k << 40) + (virtual_address >> shift) * 8;
+	}
+	for (int i = 0; i < t->num_levels; i++){
+		fill_level(&t->levels[i], page, t->clock);
+	}
+	return t->walk_levels;
+}
+
+
+void tlb_print(tlb* t){
+	for (int i = 0; i < t->num_levels; i++){
+		tlb_level* level = &t->levels[i];
+		printf("L%d TLB (%d entries, %d-way, %dKB pages) hits:%llu misses:%llu\n", i + 1, level->entries, level->ways,
+			   1 << (t->page_shift - 10), level->hits, level->misses);
+	}
+	printf("page walks:%llu walk accesses:%llu walk hits:%llu walk misses:%llu\n",
+		   t->walks, t->walk_accesses, t->walk_hits, t->walk_misses);
+}
+
+
+void tlb_free(tlb* t){
+	for (int i = 0; i < TLB_MAX_LEVELS; i++){
+		free(t->levels[i].pages);
+		free(t->levels[i].last_use);
+		t->levels[i].pages = NULL;
+		t->levels[i].last_use = NULL;
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ * tlb.h - Two level TLB and x86-64 page walk model used by csim (--tlb).
+ *     A translation that misses both TLB levels walks the page table;
+ *     the page table entry addresses it reads are handed back to csim,
+ *     which runs them through the data cache.
+ */
+
+#ifndef CSIM_TLB_H
+#define CSIM_TLB_H
+
+#include <stdbool.h>
+
+/* Most TLB levels and most page table levels in a walk */
+#define TLB_MAX_LEVELS 2
+#define PAGE_WALK_MAX_LEVELS 4
+
+/* One set associative, LRU TLB level */
+typedef struct {
+    int entries;
+    int ways;
+    int sets;
+    unsigned long long* pages;      /* virtual page number + 1 per entry, 0 for an empty entry */
+    unsigned long long* last_use;   /* for LRU replacement within a set */
+    unsigned long long hits;
+    unsigned long long misses;
+} tlb_level;
+
+typedef struct {
+    tlb_level levels[TLB_MAX_LEVELS];
+    int num_levels;
+    int page_shift;                 /* 12, 21 or 30 */
+    int walk_levels;                /* page table levels read by a walk: 4, 3 or 2 */
+    unsigned long long clock;
+    unsigned long long walks;
+    int last_hit_level;             /* level the last translation hit in, -1 if it walked */
+    /* filled in by csim from the cache results of the walk's reads */
+    unsigned long long walk_accesses;
+    unsigned long long walk_hits;
+    unsigned long long walk_misses;
+} tlb;
+
+/*
+ * tlb_init - Set up the TLB levels from "<entries>:<ways>[,<entries>:<ways>]"
+ *     and the page size from "4k", "2m" or "1g". Returns false on a
+ *     malformed configuration.
+ */
+bool tlb_init(tlb* t, const char* levels, const char* page_size);
+
+/*
+ * tlb_translate - Look up the page of a virtual address. On a miss in
+ *     every level, fills pte_addresses with the page table entries the
+ *     walk reads (root level first) and returns how many there are;
+ *     returns 0 when a TLB level hit.
+ */
+int tlb_translate(tlb* t, unsigned long long address, unsigned long long* pte_addresses);
+
+/* tlb_print - Print the per level hit/miss counts and the walk cost */
+void tlb_print(tlb* t);
+
+/* tlb_free - Release the TLB arrays */
+void tlb_free(tlb* t);
+
+#endif /* CSIM_TLB_H */
@@ -0,0 +1,694 @@
+/*
+* Title: trace.c
+*
+* Purpose: trace.c reads traces and filters their records at ingest time. The trace file is mapped into memory and each
+*	line is handed to the parser where it lies, so csim never copies a record; only a last line without a newline is
+*	copied, so that the parser always finds a terminator. The filter replaces the separate pass test-trans used to make
+*	over a trace: it keeps the records between two marker addresses, inside or outside address ranges, within a range of
+*	record indices and of the chosen operation types, and tells csim when no later record can pass so it can stop reading.
+*	Several traces can be replayed into one cache: the merger interleaves their records round robin, by weight, or by
+*	timestamp, still reading every trace in place. Binary traces (see trace_binary_record) are read the same way, one
+*	fixed size record at a time instead of one line.
+*/
+
+#define _DEFAULT_SOURCE
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//bit of each operation type in trace_filter.ops
+#define OP_BIT_LOAD   1u
+#define OP_BIT_STORE  2u
+#define OP_BIT_MODIFY 4u
+#define OP_BITS_ALL   (OP_BIT_LOAD | OP_BIT_STORE | OP_BIT_MODIFY)
+
+
+bool trace_open(trace_reader* reader, const char* path){
+	memset(reader, 0, sizeof(trace_reader));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0){
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0){
+		close(fd);
+		return false;
+	}
+	reader->size = (size_t) info.st_size;
+	if (reader->size > 0){
+		void* mapped = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED){
+			close(fd);
+			return false;
+		}
+		//records are read front to back exactly once
+		madvise(mapped, reader->size, MADV_SEQUENTIAL);
+		reader->data = (const char*) mapped;
+	}
+	//the mapping stays valid after the descriptor is closed
+	close(fd);
+
+	//a binary trace is recognized by its header, its records start right after it
+	if (reader->size >= TRACE_BINARY_HEADER &&
+		memcmp(reader->data, TRACE_BINARY_MAGIC, sizeof(TRACE_BINARY_MAGIC) - 1) == 0){
+		reader->binary = true;
+		reader->next = TRACE_BINARY_HEADER;
+	}
+	return true;
+}
+
+
+const char* trace_next_line(trace_reader* reader, long long* offset){
+	if (reader->next >= reader->size){
+		return NULL;
+	}
+	const char* line = reader->data + reader->next;
+	if (reader->binary){
+		//a truncated last record is dropped
+		if (reader->size - reader->next < sizeof(trace_binary_record)){
+			reader->next = reader->size;
+			return NULL;
+		}
+		*offset = (long long) reader->next;
+		reader->next += sizeof(trace_binary_record);
+		return line;
+	}
+	const char* end = memchr(line, '\n', reader->size - reader->next);
+	*offset = (long long) reader->next;
+	if (end != NULL){
+		reader->next = (size_t) (end - reader->data) + 1;
+		return line;
+	}
+
+	//the last line has no newline: copy it so it is terminated
+	size_t length = reader->size - reader->next;
+	if (length >= TRACE_TAIL_SIZE){
+		length = TRACE_TAIL_SIZE - 1;
+	}
+	memcpy(reader->tail, line, length);
+	reader->tail[length] = '\0';
+	reader->next = reader->size;
+	return reader->tail;
+}
+
+
+bool trace_seek(trace_reader* reader, long long offset){
+	if (offset < 0 || (size_t) offset > reader->size){
+		return false;
+	}
+	//binary records can only be resumed at a record boundary
+	if (reader->binary && (offset < TRACE_BINARY_HEADER ||
+		(offset - TRACE_BINARY_HEADER) % (long long) sizeof(trace_binary_record) != 0)){
+		return false;
+	}
+	reader->next = (size_t) offset;
+	return true;
+}
+
+
+long long trace_skip(trace_reader* reader, long long offset, long long bytes){
+	size_t start = (size_t) offset < reader->size ? (size_t) offset : reader->size;
+	size_t target = bytes > 0 && (size_t) bytes < reader->size - start ? start + (size_t) bytes : reader->size;
+	if (reader->binary){
+		//whole records only
+		size_t records = (target - start) / sizeof(trace_binary_record);
+		target = start + records * sizeof(trace_binary_record);
+	}
+	else if (target > start && target < reader->size){
+		//landed inside a line unless the byte before is the end of one: move on to the start of the next line
+		const char* end = memchr(reader->data + target - 1, '\n', reader->size - target + 1);
+		target = end != NULL ? (size_t) (end - reader->data) + 1 : reader->size;
+	}
+	reader->next = target;
+	return (long long) (target - start);
+}
+
+
+unsigned long long trace_fingerprint(const trace_reader* reader, long long offset){
+	//FNV-1a over the start of the trace and the bytes just before offset
+	size_t regions[2][2] = {{0, TRACE_FINGERPRINT_BYTES}, {0, (size_t) offset}};
+	regions[1][0] = regions[1][1] > TRACE_FINGERPRINT_BYTES ? regions[1][1] - TRACE_FINGERPRINT_BYTES : 0;
+	unsigned long long hash = 14695981039346656037ULL;
+	for (int r = 0; r < 2; r++){
+		size_t end = regions[r][1] < reader->size ? regions[r][1] : reader->size;
+		for (size_t i = regions[r][0]; i < end; i++){
+			hash = (hash ^ (unsigned char) reader->data[i]) * 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+
+long long trace_records_before(const trace_reader* reader, long long offset){
+	size_t end = (size_t) offset < reader->size ? (size_t) offset : reader->size;
+	if (reader->binary){
+		return end > TRACE_BINARY_HEADER ? (long long) ((end - TRACE_BINARY_HEADER) / sizeof(trace_binary_record)) : 0;
+	}
+	//every line before offset ends in a newline before it
+	long long records = 0;
+	const char* p = reader->data;
+	const char* stop = reader->data + end;
+	while (p < stop && (p = memchr(p, '\n', stop - p)) != NULL){
+		records++;
+		p++;
+	}
+	return records;
+}
+
+
+bool trace_decode_record(const char* record, char* op, unsigned long long* address, int* size, int* class_id){
+	trace_binary_record decoded;
+	memcpy(&decoded, record, sizeof(decoded));
+	if (decoded.op != 'I' && decoded.op != 'L' && decoded.op != 'S' && decoded.op != 'M'){
+		return false;
+	}
+	*op = decoded.op;
+	*address = decoded.address;
+	*size = decoded.size;
+	*class_id = decoded.class_id == TRACE_NO_CLASS ? -1 : decoded.class_id;
+	return true;
+}
+
+
+bool trace_parse_line(const char* line, char* op, unsigned long long* address, int* size, int* class_id){
+	//skip the leading whitespace, then grab the operation
+	while (*line == ' ' || *line == '\t'){
+		line++;
+	}
+	if (*line == '\0' || *line == '\n' || *line == '\r'){
+		return false;
+	}
+	*op = *line++;
+	while (*line == ' ' || *line == '\t'){
+		line++;
+	}
+
+	//hexadecimal address up to the comma
+	unsigned long long value = 0;
+	int digits = 0;
+	for (;; line++, digits++){
+		char c = *line;
+		if (c >= '0' && c <= '9'){
+			value = (value << 4) | (unsigned long long) (c - '0');
+		}
+		else if (c >= 'a' && c <= 'f'){
+			value = (value << 4) | (unsigned long long) (c - 'a' + 10);
+		}
+		else if (c >= 'A' && c <= 'F'){
+			value = (value << 4) | (unsigned long long) (c - 'A' + 10);
+		}
+		else {
+			break;
+		}
+	}
+	if (digits == 0 || *line != ','){
+		return false;
+	}
+	line++;
+
+	//decimal size
+	if (*line < '0' || *line > '9'){
+		return false;
+	}
+	int length = 0;
+	while (*line >= '0' && *line <= '9'){
+		length = length * 10 + (*line - '0');
+		line++;
+	}
+
+	//optional class of service, the digits past TRACE_NO_CLASS are not read so a long number cannot overflow
+	*class_id = -1;
+	while (*line == ' ' || *line == '\t'){
+		line++;
+	}
+	if (*line >= '0' && *line <= '9'){
+		int id = 0;
+		while (*line >= '0' && *line <= '9' && id < TRACE_NO_CLASS){
+			id = id * 10 + (*line - '0');
+			line++;
+		}
+		*class_id = id;
+	}
+
+	*address = value;
+	*size = length;
+	return true;
+}
+
+
+void trace_close(trace_reader* reader){
+	if (reader->data != NULL){
+		munmap((void*) reader->data, reader->size);
+		reader->data = NULL;
+	}
+}
+
+
+/* Function to read the "@<time>" field of a line, if it has one.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const char* line --> the line, ending at a newline or a NUL
+*
+*	unsigned long long previous --> time of the trace's previous line
+*
+*	=======
+*	Returns
+*	=======
+*
+*	unsigned long long, the time of the line
+*/
+static unsigned long long line_time(const char* line, unsigned long long previous){
+	for (; *line != '\n' && *line != '\0'; line++){
+		if (*line == '@'){
+			unsigned long long value = 0;
+			for (line++; *line >= '0' && *line <= '9'; line++){
+				value = value * 10 + (unsigned long long) (*line - '0');
+			}
+			return value;
+		}
+	}
+	return previous;
+}
+
+
+/* Function to compare two sources in the timestamp heap: earlier time first, lower source on a tie.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	trace_merger* merger --> the merger
+*
+*	int a, int b --> the sources to compare
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, true if a comes before b
+*/
+static bool heap_before(trace_merger* merger, int a, int b){
+	return merger->head_time[a] < merger->head_time[b] || (merger->head_time[a] == merger->head_time[b] && a < b);
+}
+
+
+/* Function to read the next line of a source into its head and put the source into the timestamp heap.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	trace_merger* merger --> the merger
+*
+*	int source --> the source to advance
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void load_head(trace_merger* merger, int source){
+	merger->head[source] = trace_next_line(&merger->readers[source], &merger->head_offset[source]);
+	if (merger->head[source] == NULL){
+		merger->done[source] = true;
+		return;
+	}
+	//binary records carry no time and keep the trace's last one
+	if (!merger->readers[source].binary){
+		merger->head_time[source] = line_time(merger->head[source], merger->head_time[source]);
+	}
+
+	//sift up
+	int i = merger->heap_size++;
+	while (i > 0 && heap_before(merger, source, merger->heap[(i - 1) / 2])){
+		merger->heap[i] = merger->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	merger->heap[i] = source;
+}
+
+
+/* Function to take the earliest source out of the timestamp heap.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	trace_merger* merger --> the merger, with a non-empty heap
+*
+*	=======
+*	Returns
+*	=======
+*
+*	int, the source whose head line comes next
+*/
+static int pop_earliest(trace_merger* merger){
+	int earliest = merger->heap[0];
+	int last = merger->heap[--merger->heap_size];
+
+	//sift the last entry down from the root
+	int i = 0;
+	for (;;){
+		int child = 2 * i + 1;
+		if (child >= merger->heap_size){
+			break;
+		}
+		if (child + 1 < merger->heap_size && heap_before(merger, merger->heap[child + 1], merger->heap[child])){
+			child++;
+		}
+		if (!heap_before(merger, merger->heap[child], last)){
+			break;
+		}
+		merger->heap[i] = merger->heap[child];
+		i = child;
+	}
+	merger->heap[i] = last;
+	return earliest;
+}
+
+
+bool trace_merger_open(trace_merger* merger, char** paths, int num_sources, int schedule, const int* weights){
+	memset(merger, 0, sizeof(trace_merger));
+	merger->num_sources = num_sources;
+	merger->schedule = schedule;
+	for (int i = 0; i < num_sources; i++){
+		if (!trace_open(&merger->readers[i], paths[i])){
+			trace_merger_close(merger);
+			return false;
+		}
+		merger->weights[i] = schedule == SCHEDULE_WEIGHTED ? weights[i] : 1;
+		if (merger->weights[i] <= 0){
+			trace_merger_close(merger);
+			return false;
+		}
+	}
+	if (schedule == SCHEDULE_TIMESTAMP){
+		for (int i = 0; i < num_sources; i++){
+			load_head(merger, i);
+		}
+	}
+	return true;
+}
+
+
+const char* trace_merger_next(trace_merger* merger, int* source, long long* offset){
+	if (merger->schedule == SCHEDULE_TIMESTAMP){
+		while (merger->heap_size > 0){
+			int earliest = pop_earliest(merger);
+			//a source finished early is dropped as its turn comes up
+			if (merger->done[earliest]){
+				continue;
+			}
+			const char* line = merger->head[earliest];
+			*source = earliest;
+			*offset = merger->head_offset[earliest];
+			//the mapped line stays valid after its reader moves on
+			load_head(merger, earliest);
+			return line;
+		}
+		return NULL;
+	}
+
+	for (;;){
+		int pick = -1;
+		if (merger->schedule == SCHEDULE_WEIGHTED){
+			//smooth weighted round robin: every source earns its weight, the richest one pays the total and goes
+			long long total = 0;
+			for (int i = 0; i < merger->num_sources; i++){
+				if (merger->done[i]){
+					continue;
+				}
+				merger->credit[i] += merger->weights[i];
+				total += merger->weights[i];
+				if (pick < 0 || merger->credit[i] > merger->credit[pick]){
+					pick = i;
+				}
+			}
+			if (pick >= 0){
+				merger->credit[pick] -= total;
+			}
+		}
+		else {
+			for (int k = 0; k < merger->num_sources && pick < 0; k++){
+				int candidate = (merger->cursor + k) % merger->num_sources;
+				if (!merger->done[candidate]){
+					pick = candidate;
+				}
+			}
+			if (pick >= 0){
+				merger->cursor = (pick + 1) % merger->num_sources;
+			}
+		}
+		if (pick < 0){
+			return NULL;
+		}
+
+		const char* line = trace_next_line(&merger->readers[pick], offset);
+		if (line != NULL){
+			*source = pick;
+			return line;
+		}
+		merger->done[pick] = true;
+	}
+}
+
+
+void trace_merger_finish(trace_merger* merger, int source){
+	merger->done[source] = true;
+}
+
+
+void trace_merger_close(trace_merger* merger){
+	for (int i = 0; i < merger->num_sources; i++){
+		trace_close(&merger->readers[i]);
+	}
+}
+
+
+void trace_filter_init(trace_filter* filter){
+	memset(filter, 0, sizeof(trace_filter));
+	filter->last_record = -1;
+	filter->ops = OP_BITS_ALL;
+}
+
+
+/* Function to read a hexadecimal number, with or without a 0x prefix.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const char** text --> the text to read, moved past the number
+*
+*	unsigned long long* value --> filled with the number
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, false if there were no digits
+*/
+static bool parse_hex(const char** text, unsigned long long* value){
+	char* end;
+	if ((*text)[0] == '0' && ((*text)[1] == 'x' || (*text)[1] == 'X')){
+		*text += 2;
+	}
+	if (!((**text >= '0' && **text <= '9') || (**text >= 'a' && **text <= 'f') || (**text >= 'A' && **text <= 'F'))){
+		return false;
+	}
+	*value = strtoull(*text, &end, 16);
+	*text = end;
+	return true;
+}
+
+
+bool trace_filter_add_range(trace_filter* filter, const char* spec, bool include){
+	address_range range = {0, ~0ULL};
+	if (*spec != '-' && !parse_hex(&spec, &range.low)){
+		return false;
+	}
+	if (*spec == '-'){
+		spec++;
+		if (*spec != '\0' && !parse_hex(&spec, &range.high)){
+			return false;
+		}
+	}
+	else {
+		//a single address
+		range.high = range.low;
+	}
+	if (*spec != '\0' || range.low > range.high){
+		return false;
+	}
+
+	if (include){
+		if (filter->num_include == TRACE_MAX_RANGES){
+			return false;
+		}
+		filter->include[filter->num_include++] = range;
+	}
+	else {
+		if (filter->num_exclude == TRACE_MAX_RANGES){
+			return false;
+		}
+		filter->exclude[filter->num_exclude++] = range;
+	}
+	filter->active = true;
+	return true;
+}
+
+
+bool trace_filter_set_markers(trace_filter* filter, const char* spec){
+	if (!parse_hex(&spec, &filter->marker_start) || *spec++ != ',' ||
+		!parse_hex(&spec, &filter->marker_end) || *spec != '\0'){
+		return false;
+	}
+	filter->use_markers = true;
+	filter->marker_state = MARKERS_BEFORE;
+	filter->active = true;
+	return true;
+}
+
+
+bool trace_filter_set_records(trace_filter* filter, const char* spec){
+	char* end;
+	filter->first_record = 0;
+	filter->last_record = -1;
+	if (*spec != '-'){
+		filter->first_record = strtoll(spec, &end, 10);
+		if (end == spec){
+			return false;
+		}
+		spec = end;
+	}
+	if (*spec == '-'){
+		spec++;
+		if (*spec != '\0'){
+			filter->last_record = strtoll(spec, &end, 10);
+			if (end == spec){
+				return false;
+			}
+			spec = end;
+		}
+	}
+	else {
+		//a single record
+		filter->last_record = filter->first_record;
+	}
+	if (*spec != '\0' || filter->first_record < 0 ||
+		(filter->last_record >= 0 && filter->last_record < filter->first_record)){
+		return false;
+	}
+	filter->active = true;
+	return true;
+}
+
+
+bool trace_filter_set_ops(trace_filter* filter, const char* spec){
+	filter->ops = 0;
+	for (; *spec != '\0'; spec++){
+		switch (*spec){
+			case 'L':
+				filter->ops |= OP_BIT_LOAD;
+			break;
+			case 'S':
+				filter->ops |= OP_BIT_STORE;
+			break;
+			case 'M':
+				filter->ops |= OP_BIT_MODIFY;
+			break;
+			default:
+				return false;
+		}
+	}
+	filter->active = true;
+	return filter->ops != 0;
+}
+
+
+/* Function to check whether an address lies in one of a list of ranges.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const address_range* ranges --> the ranges
+*
+*	int count --> number of ranges
+*
+*	unsigned long long address --> the address to look for
+*
+*	=======
+*	Returns
+*	=======
+*
+*	bool, true if some range holds the address
+*/
+static bool in_ranges(const address_range* ranges, int count, unsigned long long address){
+	for (int i = 0; i < count; i++){
+		if (address >= ranges[i].low && address <= ranges[i].high){
+			return true;
+		}
+	}
+	return false;
+}
+
+
+bool trace_filter_accept(trace_filter* filter, char op, unsigned long long address){
+	unsigned int bit;
+	switch (op){
+		case 'L':
+			bit = OP_BIT_LOAD;
+		break;
+		case 'S':
+			bit = OP_BIT_STORE;
+		break;
+		case 'M':
+			bit = OP_BIT_MODIFY;
+		break;
+		default:
+			return false;
+	}
+	long long index = filter->records++;
+
+	//the marker window is tracked on every record, whatever the other filters say about it
+	bool in_window = true;
+	if (filter->use_markers){
+		if (filter->marker_state == MARKERS_BEFORE && address == filter->marker_start){
+			filter->marker_state = MARKERS_INSIDE;
+		}
+		in_window = filter->marker_state == MARKERS_INSIDE;
+		if (in_window && address == filter->marker_end){
+			//the end marker itself is still inside the window
+			filter->marker_state = MARKERS_AFTER;
+			filter->finished = true;
+		}
+	}
+	if (filter->last_record >= 0 && index >= filter->last_record){
+		filter->finished = true;
+	}
+
+	if (!in_window || index < filter->first_record || (filter->last_record >= 0 && index > filter->last_record) ||
+		!(filter->ops & bit) ||
+		(filter->num_include > 0 && !in_ranges(filter->include, filter->num_include, address)) ||
+		in_ranges(filter->exclude, filter->num_exclude, address)){
+		return false;
+	}
+	filter->kept++;
+	return true;
+}
+
+
+void trace_filter_print(trace_filter* filter){
+	printf("trace filter kept %lld of %lld records%s\n", filter->kept, filter->records,
+		   filter->use_markers && filter->marker_state == MARKERS_BEFORE ? " (start marker not found)" : "");
+}
@@ -0,0 +1,223 @@
+/*
+ * trace.h - Trace reader and ingest filters used by csim.
+ *     The reader maps the trace file and hands out pointers to its
+ *     lines in place, so records are parsed without copying them. The
+ *     filter decides which records are simulated: address ranges to
+ *     include or exclude, a window between two marker addresses, a
+ *     range of record indices and the operation types to keep.
+ */
+
+#ifndef CSIM_TRACE_H
+#define CSIM_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Longest final line without a newline that the reader can return */
+#define TRACE_TAIL_SIZE 256
+
+/*
+ * Binary traces start with TRACE_BINARY_MAGIC padded to a 16 byte header,
+ * followed by fixed size records in the machine's byte order. They are
+ * read in place like text traces; trace_next_line returns each record.
+ */
+#define TRACE_BINARY_MAGIC "CSIMBIN1"
+#define TRACE_BINARY_HEADER 16
+
+/* class_id of a binary record without a class of service */
+#define TRACE_NO_CLASS 255
+
+typedef struct {
+    unsigned long long address;
+    char op;                        /* I, L, S or M */
+    unsigned char size;
+    unsigned char class_id;
+    unsigned char reserved[5];
+} trace_binary_record;
+
+/* Most traces replayed together */
+#define TRACE_MAX_SOURCES 16
+
+/* How records of several traces are interleaved */
+#define SCHEDULE_ROUND_ROBIN 0
+#define SCHEDULE_WEIGHTED    1
+#define SCHEDULE_TIMESTAMP   2
+
+/* Most include and most exclude ranges */
+#define TRACE_MAX_RANGES 16
+
+typedef struct {
+    const char* data;               /* the mapped file, NULL when it is empty */
+    size_t size;
+    size_t next;                    /* offset of the next line */
+    char tail[TRACE_TAIL_SIZE];     /* NUL terminated copy of an unterminated last line */
+    bool binary;                    /* records are trace_binary_record, not lines */
+} trace_reader;
+
+/*
+ * Several traces read as one stream. Round robin takes one record from
+ * each trace in turn, weighted takes them in proportion to the weights
+ * (smooth weighted round robin), and timestamp merges the traces by the
+ * "@<time>" field at the end of their records with a heap, the way a
+ * k-way merge does; a line without a time keeps its trace's last time.
+ */
+typedef struct {
+    trace_reader readers[TRACE_MAX_SOURCES];
+    int num_sources;
+    int schedule;
+    bool done[TRACE_MAX_SOURCES];
+    int cursor;                     /* round robin: the source to read next */
+    int weights[TRACE_MAX_SOURCES];
+    long long credit[TRACE_MAX_SOURCES];
+    /* timestamp merge: the next line of each source, keyed by its time */
+    const char* head[TRACE_MAX_SOURCES];
+    long long head_offset[TRACE_MAX_SOURCES];
+    unsigned long long head_time[TRACE_MAX_SOURCES];
+    int heap[TRACE_MAX_SOURCES];
+    int heap_size;
+} trace_merger;
+
+/* Inclusive address range */
+typedef struct {
+    unsigned long long low;
+    unsigned long long high;
+} address_range;
+
+/* Where a marker window is */
+#define MARKERS_BEFORE 0
+#define MARKERS_INSIDE 1
+#define MARKERS_AFTER  2
+
+typedef struct {
+    address_range include[TRACE_MAX_RANGES];
+    int num_include;                /* 0 keeps every address not excluded */
+    address_range exclude[TRACE_MAX_RANGES];
+    int num_exclude;
+
+    bool use_markers;
+    unsigned long long marker_start;
+    unsigned long long marker_end;
+    int marker_state;
+
+    long long first_record;         /* record indices to keep, counted over L, S and M records from 0 */
+    long long last_record;          /* -1 for no upper bound */
+    unsigned int ops;               /* bit per kept operation, see trace_filter_set_ops */
+
+    bool active;                    /* any filter configured */
+    bool finished;                  /* no later record can pass: end marker or last record reached */
+    long long records;              /* L, S and M records seen */
+    long long kept;                 /* records that passed */
+} trace_filter;
+
+/*
+ * trace_open - Map a trace file, text or binary. Returns false if it
+ *     cannot be opened or mapped.
+ */
+bool trace_open(trace_reader* reader, const char* path);
+
+/*
+ * trace_next_line - Return the next line, which ends at its '\n' (or
+ *     '\0' for the last line), and store its offset in the file.
+ *     Returns NULL at the end of the trace.
+ */
+const char* trace_next_line(trace_reader* reader, long long* offset);
+
+/*
+ * trace_decode_record - Unpack a record returned by trace_next_line
+ *     from a binary trace. class_id is -1 when the record has none.
+ *     Returns false if the operation is not I, L, S or M.
+ */
+bool trace_decode_record(const char* record, char* op, unsigned long long* address, int* size, int* class_id);
+
+/*
+ * trace_parse_line - Parse a text record such as " L 7fefe05a8,8",
+ *     optionally followed by a class of service number, in place: it
+ *     stops at the newline. It does the job of sscanf without the format
+ *     interpretation, which dominated the run time on long traces.
+ *     class_id is -1 when the record has none. Returns false if the line
+ *     is not a complete record.
+ */
+bool trace_parse_line(const char* line, char* op, unsigned long long* address, int* size, int* class_id);
+
+/* trace_seek - Continue reading at a line (or binary record) starting at offset */
+bool trace_seek(trace_reader* reader, long long offset);
+
+/*
+ * trace_skip - Continue reading about bytes after offset, at the start of
+ *     the next line (or the last whole binary record) from there, without
+ *     looking at the lines in between. Returns the bytes actually skipped.
+ */
+long long trace_skip(trace_reader* reader, long long offset, long long bytes);
+
+/* Bytes at the start of a trace, and before an offset, that trace_fingerprint hashes */
+#define TRACE_FINGERPRINT_BYTES 4096
+
+/*
+ * trace_fingerprint - Hash of the first TRACE_FINGERPRINT_BYTES of the
+ *     trace and of the TRACE_FINGERPRINT_BYTES before offset, so a saved
+ *     position can be checked against the trace it is used with
+ */
+unsigned long long trace_fingerprint(const trace_reader* reader, long long offset);
+
+/*
+ * trace_records_before - Number of lines (or binary records) that start
+ *     before offset, which trace_next_line would have returned by then
+ */
+long long trace_records_before(const trace_reader* reader, long long offset);
+
+/* trace_close - Unmap the trace */
+void trace_close(trace_reader* reader);
+
+/*
+ * trace_merger_open - Map every trace and set up the schedule. weights
+ *     is only read for SCHEDULE_WEIGHTED. Returns false if a trace
+ *     cannot be opened or a weight is not positive.
+ */
+bool trace_merger_open(trace_merger* merger, char** paths, int num_sources, int schedule, const int* weights);
+
+/*
+ * trace_merger_next - Return the next line of the interleaved stream,
+ *     with the trace it came from and its offset in that trace. Returns
+ *     NULL once every trace is exhausted or done.
+ */
+const char* trace_merger_next(trace_merger* merger, int* source, long long* offset);
+
+/* trace_merger_finish - Stop reading a trace before its end */
+void trace_merger_finish(trace_merger* merger, int source);
+
+/* trace_merger_close - Unmap every trace */
+void trace_merger_close(trace_merger* merger);
+
+/* trace_filter_init - Set up a filter that keeps every record */
+void trace_filter_init(trace_filter* filter);
+
+/*
+ * trace_filter_add_range - Add an include (or exclude) range given as
+ *     "<low>-<high>" in hexadecimal; either end may be left out.
+ */
+bool trace_filter_add_range(trace_filter* filter, const char* spec, bool include);
+
+/*
+ * trace_filter_set_markers - Keep only the records from the first
+ *     access to <start> up to and including the first access to <end>
+ *     after it, given as "<start>,<end>" in hexadecimal.
+ */
+bool trace_filter_set_markers(trace_filter* filter, const char* spec);
+
+/* trace_filter_set_records - Keep record indices "<first>-<last>" (either may be left out) */
+bool trace_filter_set_records(trace_filter* filter, const char* spec);
+
+/* trace_filter_set_ops - Keep only the operation types listed, e.g. "LS" */
+bool trace_filter_set_ops(trace_filter* filter, const char* spec);
+
+/*
+ * trace_filter_accept - Decide whether a parsed record is simulated.
+ *     Instruction records never pass (csim ignores them anyway) and do
+ *     not count as records.
+ */
+bool trace_filter_accept(trace_filter* filter, char op, unsigned long long address);
+
+/* trace_filter_print - Print how many records the filter kept */
+void trace_filter_print(trace_filter* filter);
+
+#endif /* CSIM_TRACE_H */
@@ -4,9 +4,16 @@
  * 
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * addresses are recorded in file for later use, or written to stderr
+ * with -m so that several tracegens can run at once, together with the
+ * address ranges of the two matrices.
+ *
+ * The matrices live in one heap block of any size: A, then B at the
+ * next multiple of the alignment plus an optional padding, so where B
+ * falls relative to A in the cache can be varied.
  */
 
+#define _POSIX_C_SOURCE 200112L
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
@@ -25,20 +32,25 @@ extern void registerFunctions();
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
-static int A[256][256];
-static int B[256][256];
+/* Default alignment of A and B: a page, so B - A is a multiple of the
+   cache sizes that matter, as it was with the old static arrays */
+#define DEFAULT_ALIGNMENT 4096
+
+static void* A;
+static void* B;
 static int M;
 static int N;
 
 
+/*
+ * validate - Check B against A element by element, the way
+ * correctTrans() would have filled it, without a third matrix
+ */
 int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
-    int C[M][N];
-    memset(C,0,sizeof(C));
-    correctTrans(M,N,A,C);
     for(int i=0;i<M;i++) {
         for(int j=0;j<N;j++) {
-            if(B[i][j]!=C[i][j]) {
-                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,C[i][j],B[i][j],i,j);
+            if(B[i][j]!=A[j][i]) {
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,A[j][i],B[i][j],i,j);
                 return 0;
             }
         }
@@ -46,12 +58,48 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/*
+ * allocate_matrices - Place A and B in one aligned heap block, B
+ * starting padding bytes after the first aligned address past A
+ */
+int allocate_matrices(long alignment, long padding) {
+    size_t bytes = sizeof(int) * (size_t) M * N;
+    size_t offset = (bytes + alignment - 1) / alignment * alignment + padding;
+    void* block;
+    if (posix_memalign(&block, alignment, offset + bytes) != 0)
+        return 0;
+    A = block;
+    B = (char*) block + offset;
+    return 1;
+}
+
+/*
+ * run_function - Run one registered function between the markers. An
+ * in-place function gets a copy of A in B, made before the start
+ * marker so the copy is not part of its trace.
+ */
+void run_function(int fn) {
+    if (func_list[fn].in_place) {
+        memcpy(B, A, sizeof(int) * (size_t) M * N);
+        MARKER_START = 33;
+        (*func_list[fn].func_ptr)(M, N, (int (*)[M]) B, B);
+        MARKER_END = 34;
+        return;
+    }
+    MARKER_START = 33;
+    (*func_list[fn].func_ptr)(M, N, A, B);
+    MARKER_END = 34;
+}
+
 int main(int argc, char* argv[]){
     int i;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    long alignment = DEFAULT_ALIGNMENT;
+    long padding = 0;
+    int markers_to_stderr = 0;
+    while( (c=getopt(argc,argv,"M:N:F:a:p:m")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -62,6 +110,15 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'a':
+            alignment = atol(optarg);
+            break;
+        case 'p':
+            padding = atol(optarg);
+            break;
+        case 'm':
+            markers_to_stderr = 1;
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -70,33 +127,52 @@ int main(int argc, char* argv[]){
     }
   
 
+    /* The alignment has to be a power of two multiple of a pointer */
+    if (M <= 0 || N <= 0 || padding < 0 || alignment < (long) sizeof(void*) ||
+        (alignment & (alignment - 1)) != 0) {
+        printf("./tracegen needs -M and -N, a power of two alignment and a non-negative padding.\n");
+        exit(1);
+    }
+    if (!allocate_matrices(alignment, padding)) {
+        printf("./tracegen could not allocate two %dx%d matrices.\n", N, M);
+        exit(1);
+    }
+
+    /* Record marker addresses, before the long trace of initMatrix; on
+       stderr they are written as the "<start>,<end>" window the trace
+       filter takes, followed by the "<low>-<high>" ranges of A and B */
+    if (markers_to_stderr) {
+        unsigned long long bytes = sizeof(int) * (unsigned long long) M * N;
+        fprintf(stderr, "%llx,%llx %llx-%llx %llx-%llx\n",
+                (unsigned long long int) &MARKER_START,
+                (unsigned long long int) &MARKER_END,
+                (unsigned long long int) A, (unsigned long long int) A + bytes - 1,
+                (unsigned long long int) B, (unsigned long long int) B + bytes - 1);
+        fflush(stderr);
+    } else {
+        FILE* marker_fp = fopen(".marker","w");
+        assert(marker_fp);
+        fprintf(marker_fp, "%llx %llx", 
+                (unsigned long long int) &MARKER_START,
+                (unsigned long long int) &MARKER_END );
+        fclose(marker_fp);
+    }
+
     /*  Register transpose functions */
     registerFunctions();
 
     /* Fill A with data */
     initMatrix(M,N, A, B); 
 
-    /* Record marker addresses */
-    FILE* marker_fp = fopen(".marker","w");
-    assert(marker_fp);
-    fprintf(marker_fp, "%llx %llx", 
-            (unsigned long long int) &MARKER_START,
-            (unsigned long long int) &MARKER_END );
-    fclose(marker_fp);
-
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
+            run_function(i);
             if (!validate(i,M,N,A,B))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
+        run_function(selectedFunc);
         if (!validate(selectedFunc,M,N,A,B))
             return selectedFunc+1;
 
@@ -184,6 +184,112 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N]){
 
 }
 
+
+/*
+ * transpose_recursive - Cache-oblivious transpose for any M x N. The
+ *     matrix is halved along its longer side until a piece is at most
+ *     8 rows by 4 columns, so every level of the recursion fits some
+ *     cache without knowing its size. This is not
+ *     the graded function, so it does not keep to the 12 variable limit.
+ */
+char transpose_recursive_desc[] = "Cache-oblivious recursive transpose";
+
+
+
+/* Function that transposes one piece of A into B, splitting it until it is small enough to copy directly.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns in the matrix
+*
+*	int N --> the number of rows in the matrix
+*
+*	int A[N][M] --> the source matrix, of dimensions N X M
+*
+*	int B[M][N] --> the destination matrix, where the transposed elements will reside
+*
+*	int first_row, int rows --> the rows of A in this piece
+*
+*	int first_col, int cols --> the columns of A in this piece
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void transpose_piece(int M, int N, int A[N][M], int B[M][N], int first_row, int rows, int first_col, int cols){
+	int half;
+	int row;
+	int col;
+	int diagonal_element;
+	int has_diagonal;
+
+	//split the side that is longer measured in base cases, at a multiple of the base case so pieces keep lining up
+	//with cache blocks
+	if (rows > 8 || cols > 4){
+		if (rows >= 2 * cols){
+			half = ((rows / 2) + 7) & ~7;
+			transpose_piece(M, N, A, B, first_row, half, first_col, cols);
+			transpose_piece(M, N, A, B, first_row + half, rows - half, first_col, cols);
+		}
+		else {
+			half = ((cols / 2) + 3) & ~3;
+			transpose_piece(M, N, A, B, first_row, rows, first_col, half);
+			transpose_piece(M, N, A, B, first_row, rows, first_col + half, cols - half);
+		}
+		return;
+	}
+
+	//base case, 8 rows by 4 columns: the 4 rows of B it writes are one 32 byte block each, and 4 of them still fall in
+	//distinct sets of the 1KB cache when 8 would not (64 column matrices). Copy row by row, holding back the diagonal
+	//element so A's row and B's row do not evict each other
+	for (row = first_row; row < first_row + rows; row++){
+		has_diagonal = 0;
+		diagonal_element = 0;
+		for (col = first_col; col < first_col + cols; col++){
+			if (row != col){
+				B[col][row] = A[row][col];
+			}
+			else {
+				diagonal_element = A[row][col];
+				has_diagonal = 1;
+			}
+		}
+		if (has_diagonal){
+			B[row][row] = diagonal_element;
+		}
+	}
+}
+
+
+
+/* Function that transposes the whole matrix with the recursive strategy.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns in the matrix
+*
+*	int N --> the number of rows in the matrix
+*
+*	int A[N][M] --> the source matrix, of dimensions N X M
+*
+*	int B[M][N] --> the destination matrix, where the transposed elements will reside
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+void transpose_recursive(int M, int N, int A[N][M], int B[M][N]){
+	transpose_piece(M, N, A, B, 0, N, 0, M);
+}
+
 /*
  * registerFunctions - This function registers your transpose
  *     functions with the driver.  At runtime, the driver will
@@ -198,6 +304,7 @@ void registerFunctions()
 
     /* Register any additional transpose functions */
     //registerTransFunction(good_transpose, trans_desc); 
+    registerTransFunction(transpose_recursive, transpose_recursive_desc);
 
 }
 
@@ -0,0 +1,801 @@
+/*
+ * trans_extra.c - Transpose variants for running natively rather than
+ *     under the simulator: SIMD register tiles, a thread pool, and an
+ *     in-place transpose that allocates its own bookkeeping. They use
+ *     intrinsics, threads and the heap, none of which the cache lab
+ *     allows in trans.c, so they live here and only bench-trans and
+ *     perf-trans link them. Each transpose function has the same
+ *     prototype as the ones in trans.c:
+ *     void trans(int M, int N, int A[N][M], int B[M][N]);
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <immintrin.h>
+#include "cachelab.h"
+
+/*
+ * transpose_simd - Transpose for running natively rather than under the
+ *     simulator. 64 x 64 tiles are cut into 8 x 8 (AVX2) or 4 x 4 (SSE2)
+ *     pieces that are transposed in registers. When A and B together do
+ *     not fit in the last level cache, B is written with non-temporal
+ *     stores so it does not push A out. Under the simulator each vector
+ *     load or store shows up as one wide access.
+ */
+char transpose_simd_desc[] = "SIMD register-tiled transpose";
+
+//side of the cache tiles the register tiles are walked in: A's and B's tiles fit in L1 together
+#define SIMD_TILE 64
+
+//last level cache size to assume when the system does not report one
+#define DEFAULT_LLC_BYTES (8L << 20)
+
+
+
+/* Function to find how big the last level cache is, once.
+*
+*	=======
+*	Returns
+*	=======
+*
+*	long, size of the largest cache level the system reports, in bytes
+*/
+static long last_level_cache_bytes(){
+	static long llc_bytes = 0;
+	if (llc_bytes == 0){
+		llc_bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+		if (llc_bytes <= 0){
+			llc_bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+		}
+		if (llc_bytes <= 0){
+			llc_bytes = DEFAULT_LLC_BYTES;
+		}
+	}
+	return llc_bytes;
+}
+
+
+
+/* Function that transposes one 8 x 8 piece in AVX2 registers.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const int* src --> first element of the piece in A
+*
+*	int src_stride --> elements between rows of A
+*
+*	__m256i columns[8] --> receives the columns of the piece, which are the rows of B
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+__attribute__((target("avx2")))
+static inline void transpose_8x8_avx2(const int* src, int src_stride, __m256i columns[8]){
+	__m256i r0 = _mm256_loadu_si256((const __m256i*) (src + 0 * src_stride));
+	__m256i r1 = _mm256_loadu_si256((const __m256i*) (src + 1 * src_stride));
+	__m256i r2 = _mm256_loadu_si256((const __m256i*) (src + 2 * src_stride));
+	__m256i r3 = _mm256_loadu_si256((const __m256i*) (src + 3 * src_stride));
+	__m256i r4 = _mm256_loadu_si256((const __m256i*) (src + 4 * src_stride));
+	__m256i r5 = _mm256_loadu_si256((const __m256i*) (src + 5 * src_stride));
+	__m256i r6 = _mm256_loadu_si256((const __m256i*) (src + 6 * src_stride));
+	__m256i r7 = _mm256_loadu_si256((const __m256i*) (src + 7 * src_stride));
+
+	//interleave pairs of rows: (a0 b0 a1 b1 | a4 b4 a5 b5), (a2 b2 a3 b3 | a6 b6 a7 b7), ...
+	__m256i t0 = _mm256_unpacklo_epi32(r0, r1);
+	__m256i t1 = _mm256_unpackhi_epi32(r0, r1);
+	__m256i t2 = _mm256_unpacklo_epi32(r2, r3);
+	__m256i t3 = _mm256_unpackhi_epi32(r2, r3);
+	__m256i t4 = _mm256_unpacklo_epi32(r4, r5);
+	__m256i t5 = _mm256_unpackhi_epi32(r4, r5);
+	__m256i t6 = _mm256_unpacklo_epi32(r6, r7);
+	__m256i t7 = _mm256_unpackhi_epi32(r6, r7);
+
+	//then pairs of pairs: (a0 b0 c0 d0 | a4 b4 c4 d4), ...
+	__m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+	__m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+	__m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+	__m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+	__m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+	__m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+	__m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+	__m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+	//and swap the 128 bit halves so each register holds one column of the piece
+	columns[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+	columns[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+	columns[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+	columns[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+	columns[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	columns[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	columns[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	columns[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+
+
+/* Function that transposes one 4 x 4 piece in SSE2 registers, for processors without AVX2.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const int* src --> first element of the piece in A
+*
+*	int src_stride --> elements between rows of A
+*
+*	__m128i columns[4] --> receives the columns of the piece, which are the rows of B
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static inline void transpose_4x4_sse2(const int* src, int src_stride, __m128i columns[4]){
+	__m128i r0 = _mm_loadu_si128((const __m128i*) (src + 0 * src_stride));
+	__m128i r1 = _mm_loadu_si128((const __m128i*) (src + 1 * src_stride));
+	__m128i r2 = _mm_loadu_si128((const __m128i*) (src + 2 * src_stride));
+	__m128i r3 = _mm_loadu_si128((const __m128i*) (src + 3 * src_stride));
+
+	//(a0 b0 a1 b1), (c0 d0 c1 d1), (a2 b2 a3 b3), (c2 d2 c3 d3)
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+	__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+	__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+	__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+	columns[0] = _mm_unpacklo_epi64(t0, t1);
+	columns[1] = _mm_unpackhi_epi64(t0, t1);
+	columns[2] = _mm_unpacklo_epi64(t2, t3);
+	columns[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+
+
+/* Function that transposes one register tile with AVX2: 8 rows of A, or 16 when streaming so that every row of B it
+*  writes is a whole 64 byte line and leaves the write combining buffer complete.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const int* src --> first element of the tile in A
+*
+*	int src_stride --> elements between rows of A
+*
+*	int* dst --> first element of the tile in B, 64 byte aligned when streaming
+*
+*	int dst_stride --> elements between rows of B
+*
+*	int stream --> non-zero to store with non-temporal stores
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+__attribute__((target("avx2")))
+static void transpose_tile_avx2(const int* src, int src_stride, int* dst, int dst_stride, int stream){
+	__m256i upper[8];
+	__m256i lower[8];
+	transpose_8x8_avx2(src, src_stride, upper);
+	if (!stream){
+		for (int i = 0; i < 8; i++){
+			_mm256_storeu_si256((__m256i*) (dst + i * dst_stride), upper[i]);
+		}
+		return;
+	}
+	transpose_8x8_avx2(src + 8 * src_stride, src_stride, lower);
+	for (int i = 0; i < 8; i++){
+		_mm256_stream_si256((__m256i*) (dst + i * dst_stride), upper[i]);
+		_mm256_stream_si256((__m256i*) (dst + i * dst_stride + 8), lower[i]);
+	}
+}
+
+
+
+/* Function that transposes one register tile with SSE2: 4 rows of A, or 16 when streaming for whole lines of B.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	const int* src --> first element of the tile in A
+*
+*	int src_stride --> elements between rows of A
+*
+*	int* dst --> first element of the tile in B, 64 byte aligned when streaming
+*
+*	int dst_stride --> elements between rows of B
+*
+*	int stream --> non-zero to store with non-temporal stores
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void transpose_tile_sse2(const int* src, int src_stride, int* dst, int dst_stride, int stream){
+	__m128i pieces[4][4];
+	transpose_4x4_sse2(src, src_stride, pieces[0]);
+	if (!stream){
+		for (int i = 0; i < 4; i++){
+			_mm_storeu_si128((__m128i*) (dst + i * dst_stride), pieces[0][i]);
+		}
+		return;
+	}
+	for (int k = 1; k < 4; k++){
+		transpose_4x4_sse2(src + 4 * k * src_stride, src_stride, pieces[k]);
+	}
+	for (int i = 0; i < 4; i++){
+		for (int k = 0; k < 4; k++){
+			_mm_stream_si128((__m128i*) (dst + i * dst_stride + 4 * k), pieces[k][i]);
+		}
+	}
+}
+
+
+
+/* Function to decide whether B is written with non-temporal stores: only when the matrices outgrow the last level
+*  cache and every row of B is made of whole aligned lines.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns in the matrix
+*
+*	int N --> the number of rows in the matrix
+*
+*	const int* B --> the destination matrix
+*
+*	=======
+*	Returns
+*	=======
+*
+*	int, non-zero to stream
+*/
+static int simd_stream(int M, int N, const int* B){
+	return (long) M * N * 2 * (long) sizeof(int) > last_level_cache_bytes() && ((uintptr_t) B % 64) == 0 && N % 16 == 0;
+}
+
+
+
+/* Function that transposes a band of rows of A with register tiles inside cache tiles, falling back to element copies
+*  on the edges that do not fill a register tile.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns in the matrix
+*
+*	int N --> the number of rows in the matrix
+*
+*	int A[N][M] --> the source matrix, of dimensions N X M
+*
+*	int B[M][N] --> the destination matrix, where the transposed elements will reside
+*
+*	int first_row --> first row of the band, a multiple of SIMD_TILE
+*
+*	int last_row --> row after the band
+*
+*	int avx2 --> non-zero to use the AVX2 tiles
+*
+*	int stream --> non-zero to store with non-temporal stores, see simd_stream
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void transpose_simd_rows(int M, int N, int A[N][M], int B[M][N], int first_row, int last_row, int avx2, int stream){
+	//a register tile is width columns of A by height rows
+	int width = avx2 ? 8 : 4;
+	int height = stream ? 16 : width;
+
+	for (int row_block = first_row; row_block < last_row; row_block += SIMD_TILE){
+		int row_end = row_block + SIMD_TILE < last_row ? row_block + SIMD_TILE : last_row;
+		//rows up to row_full are covered by whole register tiles
+		int row_full = row_block + (row_end - row_block) / height * height;
+		for (int col_block = 0; col_block < M; col_block += SIMD_TILE){
+			int col_end = col_block + SIMD_TILE < M ? col_block + SIMD_TILE : M;
+			int col_full = col_block + (col_end - col_block) / width * width;
+
+			for (int row = row_block; row < row_full; row += height){
+				for (int col = col_block; col < col_full; col += width){
+					if (avx2){
+						transpose_tile_avx2(&A[row][col], M, &B[col][row], N, stream);
+					}
+					else {
+						transpose_tile_sse2(&A[row][col], M, &B[col][row], N, stream);
+					}
+				}
+				//columns to the right of the last register tile
+				for (int r = row; r < row + height; r++){
+					for (int col = col_full; col < col_end; col++){
+						B[col][r] = A[r][col];
+					}
+				}
+			}
+			//rows below the last register tile
+			for (int row = row_full; row < row_end; row++){
+				for (int col = col_block; col < col_end; col++){
+					B[col][row] = A[row][col];
+				}
+			}
+		}
+	}
+
+	//make the non-temporal stores visible before B is read
+	if (stream){
+		_mm_sfence();
+	}
+}
+
+
+
+/* Function that transposes the whole matrix with the SIMD tiles on one core.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns in the matrix
+*
+*	int N --> the number of rows in the matrix
+*
+*	int A[N][M] --> the source matrix, of dimensions N X M
+*
+*	int B[M][N] --> the destination matrix, where the transposed elements will reside
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+void transpose_simd(int M, int N, int A[N][M], int B[M][N]){
+	transpose_simd_rows(M, N, A, B, 0, N, __builtin_cpu_supports("avx2"), simd_stream(M, N, &B[0][0]));
+}
+
+
+
+/*
+ * transpose_parallel - The SIMD transpose spread over all cores. The
+ *     bands of SIMD_TILE rows of A are split into one contiguous share
+ *     per thread of a pool that lives as long as the program, so each
+ *     thread always reads the same rows of A and writes the same
+ *     columns of B. transpose_parallel_first_touch lets those threads
+ *     touch their shares first, which on a NUMA machine places each
+ *     share's pages on the node of the thread that uses it. Small
+ *     matrices are transposed on the calling thread.
+ */
+char transpose_parallel_desc[] = "Multithreaded tiled transpose";
+
+//most threads in the pool, and elements below which threads are not worth starting
+#define MAX_THREADS 256
+#define PARALLEL_MIN_ELEMENTS (1 << 20)
+
+//what the pool is asked to do
+#define JOB_TRANSPOSE 0
+#define JOB_FIRST_TOUCH 1
+
+typedef struct {
+	int kind;
+	int M;
+	int N;
+	int* A;
+	int* B;
+	int avx2;
+	int stream;
+} parallel_job;
+
+typedef struct {
+	int num_threads;
+	pthread_t threads[MAX_THREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t finished;
+	unsigned long generation;	//bumped for every job
+	int pending;				//threads still working on the current job
+	parallel_job job;
+} thread_pool;
+
+static thread_pool pool = {0, {0}, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0,
+						   {0}};
+
+
+
+/* Function that does one thread's share of a job: the bands of rows from its index's share of the matrix.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	parallel_job* job --> the job
+*
+*	int index --> the thread's index in the pool, 0 being the calling thread
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void run_share(parallel_job* job, int index){
+	int M = job->M;
+	int N = job->N;
+	int (*A)[M] = (int (*)[M]) job->A;
+	int (*B)[N] = (int (*)[N]) job->B;
+	long bands = (N + SIMD_TILE - 1) / SIMD_TILE;
+	int first_row = (int) (bands * index / pool.num_threads) * SIMD_TILE;
+	int last_row = (int) (bands * (index + 1) / pool.num_threads) * SIMD_TILE;
+	if (last_row > N){
+		last_row = N;
+	}
+	if (first_row >= last_row){
+		return;
+	}
+
+	if (job->kind == JOB_TRANSPOSE){
+		transpose_simd_rows(M, N, A, B, first_row, last_row, job->avx2, job->stream);
+		return;
+	}
+	//first touch: the rows of A this share reads and the part of every row of B it writes
+	for (int row = first_row; row < last_row; row++){
+		memset(A[row], 0, (size_t) M * sizeof(int));
+	}
+	for (int col = 0; col < M; col++){
+		memset(&B[col][first_row], 0, (size_t) (last_row - first_row) * sizeof(int));
+	}
+}
+
+
+
+/* Function that each pool thread runs: wait for a job, do its share, report back.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	void* argument --> the thread's index, cast to a pointer
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void*, never returns
+*/
+static void* pool_worker(void* argument){
+	int index = (int) (intptr_t) argument;
+	unsigned long seen = 0;
+	for (;;){
+		pthread_mutex_lock(&pool.lock);
+		while (pool.generation == seen){
+			pthread_cond_wait(&pool.start, &pool.lock);
+		}
+		seen = pool.generation;
+		parallel_job job = pool.job;
+		pthread_mutex_unlock(&pool.lock);
+
+		run_share(&job, index);
+
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.pending == 0){
+			pthread_cond_signal(&pool.finished);
+		}
+		pthread_mutex_unlock(&pool.lock);
+	}
+	return NULL;
+}
+
+
+
+/* Function that starts the pool the first time it is needed: one thread per online processor, or TRANS_THREADS of
+*  them if that is set, the calling thread being one of them.
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void start_pool(){
+	if (pool.num_threads > 0){
+		return;
+	}
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char* setting = getenv("TRANS_THREADS");
+	if (setting != NULL && atoi(setting) > 0){
+		threads = atoi(setting);
+	}
+	if (threads < 1){
+		threads = 1;
+	}
+	if (threads > MAX_THREADS){
+		threads = MAX_THREADS;
+	}
+	pool.num_threads = 1;
+	for (int i = 1; i < threads; i++){
+		if (pthread_create(&pool.threads[i], NULL, pool_worker, (void*) (intptr_t) i) != 0){
+			break;
+		}
+		pool.num_threads++;
+	}
+}
+
+
+
+/* Function that runs a job on every thread of the pool and waits for all of them.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	parallel_job* job --> the job
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void run_job(parallel_job* job){
+	start_pool();
+	pthread_mutex_lock(&pool.lock);
+	pool.job = *job;
+	pool.pending = pool.num_threads - 1;
+	pool.generation++;
+	pthread_cond_broadcast(&pool.start);
+	pthread_mutex_unlock(&pool.lock);
+
+	//the calling thread takes share 0
+	run_share(job, 0);
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.pending > 0){
+		pthread_cond_wait(&pool.finished, &pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+}
+
+
+
+/* Function that transposes the whole matrix on every core.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns in the matrix
+*
+*	int N --> the number of rows in the matrix
+*
+*	int A[N][M] --> the source matrix, of dimensions N X M
+*
+*	int B[M][N] --> the destination matrix, where the transposed elements will reside
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+void transpose_parallel(int M, int N, int A[N][M], int B[M][N]){
+	if ((long) M * N < PARALLEL_MIN_ELEMENTS){
+		transpose_simd(M, N, A, B);
+		return;
+	}
+	parallel_job job = {JOB_TRANSPOSE, M, N, &A[0][0], &B[0][0], __builtin_cpu_supports("avx2"),
+						simd_stream(M, N, &B[0][0])};
+	run_job(&job);
+}
+
+
+
+/* Function that zeroes freshly allocated matrices from the pool threads, each touching the part transpose_parallel
+*  will have it work on. Call it before anything else writes the matrices.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns in the matrix
+*
+*	int N --> the number of rows in the matrix
+*
+*	int A[N][M] --> the source matrix, of dimensions N X M
+*
+*	int B[M][N] --> the destination matrix
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+void transpose_parallel_first_touch(int M, int N, int A[N][M], int B[M][N]){
+	parallel_job job = {JOB_FIRST_TOUCH, M, N, &A[0][0], &B[0][0], 0, 0};
+	run_job(&job);
+}
+
+
+/*
+ * transpose_inplace - Transpose that needs no second matrix: it is
+ *     called with A and B pointing at the same memory, which holds A on
+ *     entry and B on return. Square matrices swap 8 x 8 blocks across
+ *     the diagonal. Other shapes follow the cycles of the permutation
+ *     that moves element i * M + j to j * N + i, marking the elements
+ *     already moved in a bit vector of M * N bits.
+ */
+char transpose_inplace_desc[] = "In-place transpose";
+
+//side of the blocks swapped across the diagonal, one 32 byte block of ints
+#define INPLACE_BLOCK 8
+
+
+
+/* Function that transposes a square matrix in place by swapping each block above the diagonal with its mirror image.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int n --> the number of rows and columns
+*
+*	int* data --> the matrix, row by row
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void transpose_square_inplace(int n, int* data){
+	for (int row_block = 0; row_block < n; row_block += INPLACE_BLOCK){
+		int row_end = row_block + INPLACE_BLOCK < n ? row_block + INPLACE_BLOCK : n;
+		for (int col_block = row_block; col_block < n; col_block += INPLACE_BLOCK){
+			int col_end = col_block + INPLACE_BLOCK < n ? col_block + INPLACE_BLOCK : n;
+			for (int row = row_block; row < row_end; row++){
+				//a block on the diagonal swaps only its own upper half
+				for (int col = col_block == row_block ? row + 1 : col_block; col < col_end; col++){
+					int upper = data[(long) row * n + col];
+					data[(long) row * n + col] = data[(long) col * n + row];
+					data[(long) col * n + row] = upper;
+				}
+			}
+		}
+	}
+}
+
+
+
+/* Function that checks whether an element is the smallest position of its cycle under the transpose permutation,
+*  which is what transpose_cycles_inplace uses when it cannot get memory to mark the elements it has moved.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns before the transpose
+*
+*	int N --> the number of rows before the transpose
+*
+*	long start --> the position to check
+*
+*	=======
+*	Returns
+*	=======
+*
+*	int, 1 if no other position of start's cycle is smaller, else 0
+*/
+static int is_cycle_leader(int M, int N, long start){
+	long position = (start % M) * N + start / M;
+	while (position > start){
+		position = (position % M) * N + position / M;
+	}
+	return position == start;
+}
+
+
+
+/* Function that transposes a rectangular matrix in place by following the cycles of the transpose permutation.
+*  Each cycle is followed once: a bitmap marks the elements already moved, and if it cannot be allocated each cycle is
+*  started only from its smallest position instead, which needs no memory but walks every cycle once per element.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns before the transpose
+*
+*	int N --> the number of rows before the transpose
+*
+*	int* data --> the matrix, row by row
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+static void transpose_cycles_inplace(int M, int N, int* data){
+	long size = (long) M * N;
+	unsigned char* moved = (unsigned char*) calloc((size_t) (size + 7) / 8, 1);
+
+	//the first and last elements stay where they are
+	for (long start = 1; start < size - 1; start++){
+		if (moved != NULL ? (moved[start >> 3] & (1u << (start & 7))) != 0 : !is_cycle_leader(M, N, start)){
+			continue;
+		}
+		//carry the element at start to where it belongs, pick up the one there, and so on round the cycle
+		int carried = data[start];
+		long position = start;
+		do {
+			long target = (position % M) * N + position / M;
+			int displaced = data[target];
+			data[target] = carried;
+			carried = displaced;
+			if (moved != NULL){
+				moved[target >> 3] |= (unsigned char) (1u << (target & 7));
+			}
+			position = target;
+		} while (position != start);
+	}
+	free(moved);
+}
+
+
+
+/* Function that transposes the matrix in place, A and B being the same memory.
+*
+*	=========
+*	Arguments
+*	=========
+*
+*	int M --> the number of columns in the matrix
+*
+*	int N --> the number of rows in the matrix
+*
+*	int A[N][M] --> the matrix to transpose
+*
+*	int B[M][N] --> the same memory as A, where the transposed elements will reside
+*
+*	=======
+*	Returns
+*	=======
+*
+*	void
+*/
+void transpose_inplace(int M, int N, int A[N][M], int B[M][N]){
+	if (M == N){
+		transpose_square_inplace(N, &A[0][0]);
+	}
+	else {
+		transpose_cycles_inplace(M, N, &A[0][0]);
+	}
+}
+
+
+/*
+ * registerExtraFunctions - Registers the functions of this file with
+ *     the driver, after registerFunctions() has registered trans.c's.
+ */
+void registerExtraFunctions()
+{
+    registerTransFunction(transpose_simd, transpose_simd_desc);
+    registerTransFunction(transpose_parallel, transpose_parallel_desc);
+    registerInPlaceTransFunction(transpose_inplace, transpose_inplace_desc);
+}
@@ -0,0 +1,21 @@
+/*
+ * walltime.h - The wall clock the benchmark tools (bench-trans,
+ *     csim-bench, synthtrace) time themselves with.
+ */
+
+#ifndef WALLTIME_H
+#define WALLTIME_H
+
+#include <time.h>
+
+/*
+ * now - Wall clock time in seconds, from a clock that never jumps
+ */
+static inline double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif /* WALLTIME_H */